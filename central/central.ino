@@ -1,62 +1,79 @@
 #include <bluefruit.h>
+#include <nest_protocol.h>  // UUIDs, DataPoint and packet layout shared with the feathers
 
-// BLE UUIDs (must match peripheral)
-#define SERVICE_UUID                   "12345678-1234-1234-1234-123456789abc"
-#define DATA_CHARACTERISTIC_UUID       "87654321-4321-4321-4321-cba987654321"
-#define ACK_CHARACTERISTIC_UUID        "11223344-5566-7788-99aa-bbccddeeff00"
+// Feathers drained at the same time, each on its own central link
+#define MAX_LINKS 4
+// Points kept per link, a full feather batch. With the sequence numbers that
+// is 16 bytes a point: 200 * 16 * MAX_LINKS = 12.5 KB of the nRF52840's RAM
+#define MAX_POINTS_PER_LINK MAX_BATCH_POINTS
+// Ask for missing packets after this long without one, drop the link after
+// MAX_NACK_ROUNDS unanswered requests; the feather keeps the unACKed batch
+#define NACK_TIMEOUT_MS 1000
+#define MAX_NACK_ROUNDS 5
+// A feather starts its batch within its 10 s send interval of connecting
+#define FIRST_PACKET_TIMEOUT_MS 15000
+// 1: stream each batch as binary gateway frames (see nest_protocol.h) for the
+// PC-side nest_ingest tool instead of printing a text summary
+#define BINARY_OUTPUT 0
 
-// Target device names - can match multiple peripherals
-const char* TARGET_DEVICE_NAMES[] = {"nRF_01", "nRF_02", "nRF_03"};
-const int NUM_TARGET_DEVICES = 3;
-
-// BLE client objects
-BLEClientService        dataService(SERVICE_UUID);
-BLEClientCharacteristic dataCharacteristic(DATA_CHARACTERISTIC_UUID);
-BLEClientCharacteristic ackCharacteristic(ACK_CHARACTERISTIC_UUID);
-
-// Data structures (must match peripheral)
-struct DataPoint {
-  uint8_t val1;   // 8 bits: 0-255 (for your 0 or 1 values)
-  uint32_t val2;  // 32 bits: 0 to 4,294,967,295 (handles your 0-65,545 range)
-  uint32_t val3;  // 32 bits: 0 to 4,294,967,295 (handles your 0-65,545 range)
-};
-
-struct DataPacket {
-  uint16_t packetNumber;    // 2 bytes - supports up to 65,535 packets
-  uint16_t totalPackets;    // 2 bytes - supports up to 65,535 packets
-  uint8_t pointsInPacket;   // 1 byte
-  DataPoint points[1];      // 1 point = 9 bytes, total packet = 14 bytes
+// One connected feather: its client objects and reception state, all fixed-size
+struct FeatherLink {
+  uint16_t connHandle;  // BLE_CONN_HANDLE_INVALID while the link is free
+  uint8_t peerAddress[GATEWAY_ADDRESS_SIZE];  // Feather's BLE address, identifies it in gateway frames
+  BLEClientService dataService;
+  BLEClientCharacteristic dataCharacteristic;
+  BLEClientCharacteristic ackCharacteristic;
+  
+  // Reception state
+  DataPoint receivedData[MAX_POINTS_PER_LINK];
+  uint32_t receivedSequence[MAX_POINTS_PER_LINK];  // Record sequence of each point, packets may arrive out of order
+  int totalReceivedPoints;
+  int expectedPackets;
+  int receivedPackets;
+  uint8_t receivedPacketBitmap[MAX_BATCH_PACKETS / 8];
+  volatile bool batchComplete;  // Set by the notify callback, handled in loop()
+  volatile unsigned long lastPacketTime;  // millis() of the last packet, or of connecting
+  int nackRounds;
 };
 
-// Reception state
-DataPoint receivedData[500];  // Can handle up to 500 points
-int totalReceivedPoints = 0;
-int expectedPackets = 0;
-int receivedPackets = 0;
-bool isReceiving = false;
+FeatherLink links[MAX_LINKS];
 int scanCount = 0;
+unsigned long batchCount = 0;
 
 void setup() {
   Serial.begin(115200);
   while (!Serial) delay(10);
   
-  Serial.println("BLE Central - Data Receiver");
+  Serial.println("BLE Central - Multi-link Gateway");
   
   // Initialize BLE
-  Bluefruit.begin(0, 1); // 0 peripheral, 1 central
+  // Allow the full 247-byte ATT MTU so peripherals can pack many points per notification
+  Bluefruit.configCentralBandwidth(BANDWIDTH_MAX);
+  Bluefruit.begin(0, MAX_LINKS); // 0 peripheral, MAX_LINKS central
   Bluefruit.setName("nRF_Central_01");
+  // Shortest connection interval the peripherals accept: 7.5-15 ms (units of 1.25 ms)
+  Bluefruit.Central.setConnInterval(6, 12);
   
   // Set up connection callbacks
   Bluefruit.Central.setConnectCallback(connect_callback);
   Bluefruit.Central.setDisconnectCallback(disconnect_callback);
   
-  // Set up client service and characteristics
-  dataService.begin();
+  // One client service and characteristic set per link; each characteristic
+  // attaches to the service begun just before it
+  for (int i = 0; i < MAX_LINKS; i++) {
+    FeatherLink& link = links[i];
+    link.connHandle = BLE_CONN_HANDLE_INVALID;
+  
+    link.dataService.uuid = BLEUuid(SERVICE_UUID);
+    link.dataService.begin();
   
-  dataCharacteristic.begin();
-  dataCharacteristic.setNotifyCallback(data_notify_callback);
+    link.dataCharacteristic.uuid = BLEUuid(DATA_CHARACTERISTIC_UUID);
+    link.dataCharacteristic.begin();
+    link.dataCharacteristic.setNotifyCallback(data_notify_callback);
   
-  ackCharacteristic.begin();
+    link.ackCharacteristic.uuid = BLEUuid(ACK_CHARACTERISTIC_UUID);
+    link.ackCharacteristic.begin();
+  }
   
   Serial.println("BLE initialized, starting scan...");
   
@@ -65,6 +82,8 @@ void setup() {
   Bluefruit.Scanner.restartOnDisconnect(true);
   Bluefruit.Scanner.setInterval(160, 80); // in unit of 0.625 ms
   Bluefruit.Scanner.useActiveScan(true);  // Try active scanning
+  // Drop reports from anything that is not a feather before scan_callback
+  Bluefruit.Scanner.filterUuid(links[0].dataService.uuid);
   
   if (Bluefruit.Scanner.start(0)) {
     Serial.println("Scanner started successfully!");
@@ -72,137 +91,148 @@ void setup() {
     Serial.println("Failed to start scanner!");
   }
   
-  Serial.println("Scanning for any BLE devices...");
+  Serial.println("Scanning for feathers...");
 }
 
 void loop() {
-  // Check if we should be scanning but aren't
+  // Callbacks only record what happened; printing, ACKs and disconnects run here
+  for (int i = 0; i < MAX_LINKS; i++) {
+    FeatherLink& link = links[i];
+    if (link.connHandle == BLE_CONN_HANDLE_INVALID || !link.batchComplete) {
+      continue;
+    }
+    link.batchComplete = false;
+    batchCount++;
+  
+    if (BINARY_OUTPUT) {
+      streamBatchFrames(link);
+    } else {
+      processBatchData(link);
+    }
+    sendAck(link);
+  
+    // Free the link for the next feather
+    Bluefruit.disconnect(link.connHandle);
+  }
+  
+  // A feather that went quiet mid-batch is asked for what is missing; one
+  // that never starts or stops answering is dropped so the link is reused
+  for (int i = 0; i < MAX_LINKS; i++) {
+    FeatherLink& link = links[i];
+    if (link.connHandle == BLE_CONN_HANDLE_INVALID || link.batchComplete) {
+      continue;
+    }
+    unsigned long quiet = millis() - link.lastPacketTime;
+    if (link.expectedPackets == 0 ? quiet < FIRST_PACKET_TIMEOUT_MS : quiet < NACK_TIMEOUT_MS) {
+      continue;
+    }
+    link.lastPacketTime = millis();
+  
+    if (link.expectedPackets > 0 && link.nackRounds < MAX_NACK_ROUNDS) {
+      link.nackRounds++;
+      sendNack(link);
+    } else {
+      Serial.print("No packets on link ");
+      Serial.print(link.connHandle);
+      Serial.print(" for ");
+      Serial.print(quiet);
+      Serial.println(" ms - disconnecting");
+      Bluefruit.disconnect(link.connHandle);
+    }
+  }
+  
+  // Keep scanning while a link is free
   static unsigned long lastScanCheck = 0;
-  static int lastScanCount = 0;
+  static int statusCount = 0;
   
   if (millis() - lastScanCheck >= 5000) { // Check every 5 seconds
-    bool isConnected = Bluefruit.Central.connected();
+    lastScanCheck = millis();
+    int activeLinks = countActiveLinks();
     bool isScanning = Bluefruit.Scanner.isRunning();
-    
+  
     // Print status for debugging
-    static int statusCount = 0;
     if (statusCount % 4 == 0) { // Print every 20 seconds (5s * 4)
-      Serial.print("Status - Connected: ");
-      Serial.print(isConnected ? "YES" : "NO");
+      Serial.print("Status - Links: ");
+      Serial.print(activeLinks);
+      Serial.print("/");
+      Serial.print(MAX_LINKS);
       Serial.print(", Scanning: ");
       Serial.print(isScanning ? "YES" : "NO");
       Serial.print(", Scan count: ");
-      Serial.println(scanCount);
+      Serial.print(scanCount);
+      Serial.print(", Batches: ");
+      Serial.println(batchCount);
     }
     statusCount++;
-    
-    // Check if scanner is stuck (not receiving callbacks)
-    if (!isConnected && isScanning && (scanCount == lastScanCount)) {
-      Serial.println("Scanner appears stuck (no new callbacks) - forcing restart...");
-      Bluefruit.Scanner.stop();
-      delay(500);
-      
-      if (Bluefruit.Scanner.start(0)) {
-        Serial.println("Scanner force-restarted successfully");
-      } else {
-        Serial.println("Scanner force-restart failed");
-      }
-    }
-    
-    // If not scanning and not connected, restart scanner
-    if (!isScanning && !isConnected) {
-      Serial.println("Scanner not running and not connected - restarting scan...");
+  
+    if (!isScanning && activeLinks < MAX_LINKS) {
+      Serial.println("Scanner not running with a link free - restarting scan...");
       if (Bluefruit.Scanner.start(0)) {
         Serial.println("Scanner restarted in loop");
       } else {
         Serial.println("Failed to restart scanner in loop");
       }
     }
-    
-    lastScanCount = scanCount;
-    lastScanCheck = millis();
   }
-  
-  // Main loop - BLE events are handled by callbacks
-  delay(100);
+}
+
+// Link holding conn_handle; BLE_CONN_HANDLE_INVALID finds a free one
+FeatherLink* findLink(uint16_t conn_handle) {
+  for (int i = 0; i < MAX_LINKS; i++) {
+    if (links[i].connHandle == conn_handle) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+
+int countActiveLinks() {
+  int count = 0;
+  for (int i = 0; i < MAX_LINKS; i++) {
+    if (links[i].connHandle != BLE_CONN_HANDLE_INVALID) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void resetLink(FeatherLink& link) {
+  link.totalReceivedPoints = 0;
+  link.expectedPackets = 0;
+  link.receivedPackets = 0;
+  memset(link.receivedPacketBitmap, 0, sizeof(link.receivedPacketBitmap));
+  link.batchComplete = false;
+  link.lastPacketTime = millis();
+  link.nackRounds = 0;
 }
 
 void scan_callback(ble_gap_evt_adv_report_t* report) {
   scanCount++;
   
-  // Print scan activity more frequently to see if callbacks are happening
-  if (scanCount % 5 == 1) {  // Print every 5th scan instead of 10th
-    Serial.print("Scan callback called, count: ");
-    Serial.println(scanCount);
+  // Every link busy: loop() restarts the scanner once one is free
+  if (findLink(BLE_CONN_HANDLE_INVALID) == NULL) {
+    Bluefruit.Scanner.stop();
+    return;
   }
   
-  // Parse the advertising data to find device name
+  // The scanner only reports devices advertising the nest service, so every
+  // report is a feather
   uint8_t nameBuffer[32];
-  uint8_t nameLen = Bluefruit.Scanner.parseReportByType(report, BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, nameBuffer, sizeof(nameBuffer));
-  
-  if (nameLen > 0) {
-    // Null terminate the string
-    nameBuffer[min(nameLen, 31)] = '\0';
-    
-    // Debug: print ALL found devices to see what's being detected
-    Serial.print("Found device (complete name): ");
-    Serial.println((char*)nameBuffer);
-    
-    // Check if complete name matches any of our targets
-    for (int i = 0; i < NUM_TARGET_DEVICES; i++) {
-      if (strcmp((char*)nameBuffer, TARGET_DEVICE_NAMES[i]) == 0) {
-        Serial.print("*** FOUND TARGET DEVICE: ");
-        Serial.println((char*)nameBuffer);
-        
-        // Stop scanning and connect
-        Serial.println("Stopping scanner...");
-        Bluefruit.Scanner.stop();
-        Serial.println("Attempting connection...");
-        
-        if (Bluefruit.Central.connect(report)) {
-          Serial.println("Connection initiated successfully");
-        } else {
-          Serial.println("Failed to initiate connection - resuming scan...");
-          delay(500);
-          Bluefruit.Scanner.start(0);
-        }
-        return;
-      }
-    }
-  }
+  uint8_t nameLen = Bluefruit.Scanner.parseReportByType(report, BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, nameBuffer, sizeof(nameBuffer) - 1);
+  nameBuffer[nameLen] = '\0';
   
-  // Try short name if complete name not found
-  nameLen = Bluefruit.Scanner.parseReportByType(report, BLE_GAP_AD_TYPE_SHORT_LOCAL_NAME, nameBuffer, sizeof(nameBuffer));
-  if (nameLen > 0) {
-    nameBuffer[min(nameLen, 31)] = '\0';
-    Serial.print("Found device (short name): ");
-    Serial.println((char*)nameBuffer);
-    
-    // Check if short name matches any of our targets (for truncated names)
-    for (int i = 0; i < NUM_TARGET_DEVICES; i++) {
-      // Check first 5 characters for truncated names like "nRF_0" from "nRF_01"
-      if (strncmp((char*)nameBuffer, TARGET_DEVICE_NAMES[i], min(5, strlen(TARGET_DEVICE_NAMES[i]))) == 0) {
-        Serial.print("*** FOUND TARGET DEVICE BY SHORT NAME: ");
-        Serial.print((char*)nameBuffer);
-        Serial.print(" (matches ");
-        Serial.print(TARGET_DEVICE_NAMES[i]);
-        Serial.println(")");
-        
-        // Stop scanning and connect
-        Serial.println("Stopping scanner...");
-        Bluefruit.Scanner.stop();
-        Serial.println("Attempting connection...");
-        
-        if (Bluefruit.Central.connect(report)) {
-          Serial.println("Connection initiated successfully");
-        } else {
-          Serial.println("Failed to initiate connection - resuming scan...");
-          delay(500);
-          Bluefruit.Scanner.start(0);
-        }
-        return;
-      }
-    }
+  Serial.print("*** FOUND FEATHER: ");
+  Serial.print(nameLen > 0 ? (char*)nameBuffer : "(no name)");
+  Serial.print(" (RSSI ");
+  Serial.print(report->rssi);
+  Serial.println(" dBm)");
+  
+  // Connecting pauses the scanner, connect_callback starts it again
+  if (Bluefruit.Central.connect(report)) {
+    Serial.println("Connection initiated successfully");
+  } else {
+    Serial.println("Failed to initiate connection - resuming scan...");
+    Bluefruit.Scanner.resume();
   }
 }
 
@@ -217,32 +247,57 @@ void connect_callback(uint16_t conn_handle) {
     return;
   }
   
-  Serial.println("Connected to peripheral!");
+  FeatherLink* link = findLink(BLE_CONN_HANDLE_INVALID);
+  if (link == NULL) {
+    Serial.println("No free link - disconnecting");
+    Bluefruit.disconnect(conn_handle);
+    return;
+  }
+  resetLink(*link);
+  link->connHandle = conn_handle;
+  
+  Serial.print("Connected to peripheral! Links in use: ");
+  Serial.println(countActiveLinks());
+  
+  // Look for the next feather while this one transfers
+  if (countActiveLinks() < MAX_LINKS) {
+    Bluefruit.Scanner.start(0);
+  }
   
-  // Small delay before service discovery
-  delay(100);
+  // Negotiate the largest MTU, data length and 2M PHY so the peripheral can fill each notification
+  BLEConnection* conn = Bluefruit.Connection(conn_handle);
+  if (conn) {
+    ble_gap_addr_t peerAddr = conn->getPeerAddr();
+    memcpy(link->peerAddress, peerAddr.addr, GATEWAY_ADDRESS_SIZE);
+  
+    conn->requestPHY();
+    conn->requestDataLengthUpdate();
+    conn->requestMtuExchange(BLE_GATT_ATT_MTU_MAX);
+    Serial.print("Negotiated MTU: ");
+    Serial.print(conn->getMtu());
+    Serial.print(", data length: ");
+    Serial.print(conn->getDataLength());
+    Serial.print(", interval: ");
+    Serial.print(conn->getConnectionInterval() * 1.25);
+    Serial.println(" ms");
+  }
   
   // Discover services
   Serial.println("Starting service discovery...");
-  if (dataService.discover(conn_handle)) {
+  if (link->dataService.discover(conn_handle)) {
     Serial.println("Data service discovered");
-    
-    // Small delay before characteristic discovery
-    delay(100);
-    
+  
     // Discover characteristics
     Serial.println("Starting characteristic discovery...");
-    if (dataCharacteristic.discover() && ackCharacteristic.discover()) {
+    if (link->dataCharacteristic.discover() && link->ackCharacteristic.discover()) {
       Serial.println("Characteristics discovered");
-      
-      // Small delay before enabling notifications
-      delay(100);
-      
+  
       // Enable notifications for data characteristic
       Serial.println("Enabling notifications...");
-      if (dataCharacteristic.enableNotify()) {
+      if (link->dataCharacteristic.enableNotify()) {
         Serial.println("Data notifications enabled");
         Serial.println("=== CENTRAL READY TO RECEIVE DATA ===");
+        return;
       } else {
         Serial.println("Failed to enable notifications");
       }
@@ -252,6 +307,9 @@ void connect_callback(uint16_t conn_handle) {
   } else {
     Serial.println("Failed to discover service");
   }
+  
+  // A link that cannot receive is better used for another feather
+  Bluefruit.disconnect(conn_handle);
 }
 
 void disconnect_callback(uint16_t conn_handle, uint8_t reason) {
@@ -259,139 +317,215 @@ void disconnect_callback(uint16_t conn_handle, uint8_t reason) {
   Serial.print("Disconnect reason: ");
   Serial.println(reason);
   
-  // Reset reception state
-  isReceiving = false;
-  totalReceivedPoints = 0;
-  receivedPackets = 0;
-  expectedPackets = 0;
-  
-  Serial.println("Disconnected from peripheral");
-  
-  // Small delay before resuming scan
-  delay(1000);
-  
-  // Resume scanning immediately with multiple retry attempts
-  Serial.println("Automatically resuming scanning...");
-  for (int retry = 0; retry < 3; retry++) {
-    if (Bluefruit.Scanner.start(0)) {
-      Serial.println("Scanner restarted successfully!");
-      return;
-    } else {
-      Serial.print("Scanner restart attempt ");
-      Serial.print(retry + 1);
-      Serial.println(" failed - retrying...");
-      delay(1000);
+  FeatherLink* link = findLink(conn_handle);
+  if (link != NULL) {
+    if (link->expectedPackets > 0 && link->receivedPackets < link->expectedPackets) {
+      Serial.print("Batch interrupted at ");
+      Serial.print(link->receivedPackets);
+      Serial.print("/");
+      Serial.print(link->expectedPackets);
+      Serial.println(" packets - the feather keeps it for the next connection");
     }
+  
+    // Reset reception state and free the link
+    resetLink(*link);
+    link->connHandle = BLE_CONN_HANDLE_INVALID;
   }
-  Serial.println("All scanner restart attempts failed!");
+  
+  // The scanner restarts on its own (restartOnDisconnect), loop() covers the rest
+  Serial.println("Disconnected from peripheral");
 }
 
 void data_notify_callback(BLEClientCharacteristic* chr, uint8_t* data, uint16_t len) {
-  // BLE adds some overhead, so accept packets between 16-20 bytes
-  if (len >= 16 && len <= 20) {
-    DataPacket* packet = (DataPacket*)data;
-    
-    Serial.print("Received packet ");
-    Serial.print(packet->packetNumber);
-    Serial.print("/");
-    Serial.print(packet->totalPackets);
-    Serial.print(" - Point: (");
-    Serial.print(packet->points[0].val1);
-    Serial.print(", ");
-    Serial.print(packet->points[0].val2);
-    Serial.print(", ");
-    Serial.print(packet->points[0].val3);
-    Serial.println(")");
-    
-    // First packet - initialize reception
-    if (packet->packetNumber == 1) {
-      isReceiving = true;
-      expectedPackets = packet->totalPackets;
-      receivedPackets = 0;
-      totalReceivedPoints = 0;
-      Serial.println("Starting batch reception...");
-    }
-    
-    if (isReceiving) {
-      // Store the data point
-      if (totalReceivedPoints < 500) {  // Can handle up to 500 points
-        receivedData[totalReceivedPoints] = packet->points[0];
-        totalReceivedPoints++;
-      } else {
-        Serial.println("Warning: Received more than 500 points, ignoring excess");
-      }
-      
-      receivedPackets++;
-      
-      // Check if we've received all packets
-      if (receivedPackets >= expectedPackets) {
-        Serial.println("All packets received!");
-        processBatchData();
-        sendAck();
-        isReceiving = false;
-      }
-    }
-  } else {
-    Serial.print("Invalid packet size! Expected 16-20 bytes, got ");
+  // Runs once per notification on every link: no printing on the success path
+  FeatherLink* link = findLink(chr->connHandle());
+  if (link == NULL || link->batchComplete) {
+    return;
+  }
+  
+  // Packets are variable length: header plus pointsInPacket raw or delta-encoded points
+  DataPacketReader reader;
+  if (!openDataPacket(reader, data, len)) {
+    Serial.print("Invalid packet! Got ");
     Serial.print(len);
-    Serial.println(" bytes");
-    
-    // Print packet contents for debugging
-    Serial.print("Packet contents: ");
-    for (int i = 0; i < min(len, 20); i++) {
-      Serial.print(data[i], HEX);
-      Serial.print(" ");
-    }
-    Serial.println();
+    Serial.print(" bytes, protocol version ");
+    Serial.print(len > 0 ? data[0] : 0);
+    Serial.print(", format ");
+    Serial.println(len > 1 ? data[1] : 0);
+    return;
+  }
+  const DataPacketHeader& packet = reader.header;
+  link->lastPacketTime = millis();
+  
+  if (packet.packetNumber == 0 || packet.packetNumber > packet.totalPackets ||
+      packet.totalPackets > MAX_BATCH_PACKETS) {
+    return;
+  }
+  
+  // A different batch size means the peripheral restarted its upload
+  if (packet.totalPackets != link->expectedPackets) {
+    resetLink(*link);
+    link->expectedPackets = packet.totalPackets;
+  }
+  
+  // Retransmissions may repeat packets we already have
+  int bit = packet.packetNumber - 1;
+  if (link->receivedPacketBitmap[bit / 8] & (1 << (bit % 8))) {
+    return;
+  }
+  
+  // Store the data points
+  int packetStart = link->totalReceivedPoints;
+  DataPoint point;
+  uint32_t sequence = packet.firstSequence;
+  while (link->totalReceivedPoints < MAX_POINTS_PER_LINK && readDataPoint(reader, point)) {
+    link->receivedData[link->totalReceivedPoints] = point;
+    link->receivedSequence[link->totalReceivedPoints] = sequence++;
+    link->totalReceivedPoints++;
+  }
+  
+  // A truncated or malformed packet (or one that does not fit) is dropped and
+  // left unmarked, so the batch never completes and is not ACKed: the
+  // peripheral keeps those records and sends them again
+  if (reader.remaining != 0) {
+    link->totalReceivedPoints = packetStart;
+    Serial.print("Malformed packet ");
+    Serial.print(packet.packetNumber);
+    Serial.print(": ");
+    Serial.print(reader.remaining);
+    Serial.println(" points could not be stored");
+    return;
+  }
+  link->receivedPacketBitmap[bit / 8] |= 1 << (bit % 8);
+  link->receivedPackets++;
+  
+  // Check if we've received all packets
+  if (link->receivedPackets >= link->expectedPackets) {
+    link->batchComplete = true;
   }
 }
 
-void processBatchData() {
-  Serial.println("=== BATCH DATA RECEIVED ===");
-  Serial.print("Total points received: ");
-  Serial.println(totalReceivedPoints);
+void processBatchData(FeatherLink& link) {
+  Serial.print("=== BATCH DATA RECEIVED ON LINK ");
+  Serial.print(link.connHandle);
+  Serial.println(" ===");
+  Serial.print("Packets: ");
+  Serial.print(link.receivedPackets);
+  Serial.print(", total points received: ");
+  Serial.println(link.totalReceivedPoints);
   
   // Display first few and last few data points as examples
   Serial.println("First 5 data points:");
-  for (int i = 0; i < min(5, totalReceivedPoints); i++) {
-    Serial.print("Point ");
-    Serial.print(i + 1);
-    Serial.print(": (");
-    Serial.print(receivedData[i].val1);
-    Serial.print(", ");
-    Serial.print(receivedData[i].val2);
-    Serial.print(", ");
-    Serial.print(receivedData[i].val3);
-    Serial.println(")");
+  for (int i = 0; i < min(5, link.totalReceivedPoints); i++) {
+    printDataPoint(i, link.receivedData[i]);
   }
   
-  if (totalReceivedPoints > 5) {
+  if (link.totalReceivedPoints > 5) {
     Serial.println("...");
     Serial.println("Last 5 data points:");
-    for (int i = max(0, totalReceivedPoints - 5); i < totalReceivedPoints; i++) {
-      Serial.print("Point ");
-      Serial.print(i + 1);
-      Serial.print(": (");
-      Serial.print(receivedData[i].val1);
-      Serial.print(", ");
-      Serial.print(receivedData[i].val2);
-      Serial.print(", ");
-      Serial.print(receivedData[i].val3);
-      Serial.println(")");
+    for (int i = max(5, link.totalReceivedPoints - 5); i < link.totalReceivedPoints; i++) {
+      printDataPoint(i, link.receivedData[i]);
     }
   }
   
   Serial.println("=== END BATCH ===");
 }
 
-void sendAck() {
+void streamBatchFrames(FeatherLink& link) {
+  uint8_t frame[GATEWAY_MAX_PAYLOAD];
+  uint8_t encoded[GATEWAY_MAX_ENCODED];
+  
+  // One frame per run of consecutive sequences, at most GATEWAY_MAX_POINTS long
+  int start = 0;
+  while (start < link.totalReceivedPoints) {
+    int count = 1;
+    while (start + count < link.totalReceivedPoints && count < GATEWAY_MAX_POINTS &&
+           link.receivedSequence[start + count] == link.receivedSequence[start] + count) {
+      count++;
+    }
+  
+    size_t frameLen = encodeGatewayFrame(frame, link.peerAddress, link.receivedSequence[start],
+                                         &link.receivedData[start], count);
+    size_t encodedLen = cobsEncode(encoded, frame, frameLen);
+  
+    // Leading delimiter too, so text printed before the frame is not glued to it
+    Serial.write((uint8_t)GATEWAY_DELIMITER);
+    Serial.write(encoded, encodedLen);
+    Serial.write((uint8_t)GATEWAY_DELIMITER);
+  
+    start += count;
+  }
+}
+
+void printDataPoint(int index, const DataPoint& point) {
+  Serial.print("Point ");
+  Serial.print(index + 1);
+  Serial.print(": (");
+  Serial.print(point.val1);
+  Serial.print(", ");
+  Serial.print(point.val2);
+  Serial.print(", ");
+  Serial.print(point.val3);
+  Serial.println(")");
+}
+
+void sendAck(FeatherLink& link) {
   // Generate fake unix timestamp
   uint32_t fakeTimestamp = millis() / 1000 + 1640995200; // Fake epoch time
   
-  if (ackCharacteristic.write((uint8_t*)&fakeTimestamp, sizeof(fakeTimestamp))) {
+  uint8_t timestampBytes[ACK_SIZE];
+  putLe32(timestampBytes, fakeTimestamp);
+  
+  if (link.ackCharacteristic.write(timestampBytes, sizeof(timestampBytes))) {
     Serial.print("ACK sent with timestamp: ");
     Serial.println(fakeTimestamp);
   } else {
     Serial.println("Failed to send ACK");
   }
-}
\ No newline at end of file
+}
+
+void sendNack(FeatherLink& link) {
+  // Up to MAX_NACK_RANGES runs of missing packet numbers
+  uint8_t nack[MAX_NACK_SIZE];
+  int rangeCount = 0;
+  int packetNumber = 1;
+  
+  while (packetNumber <= link.expectedPackets && rangeCount < MAX_NACK_RANGES) {
+    int bit = packetNumber - 1;
+    if (link.receivedPacketBitmap[bit / 8] & (1 << (bit % 8))) {
+      packetNumber++;
+      continue;
+    }
+  
+    int first = packetNumber;
+    while (packetNumber <= link.expectedPackets &&
+           !(link.receivedPacketBitmap[(packetNumber - 1) / 8] & (1 << ((packetNumber - 1) % 8)))) {
+      packetNumber++;
+    }
+  
+    uint8_t* range = &nack[NACK_HEADER_SIZE + rangeCount * NACK_RANGE_SIZE];
+    putLe16(&range[0], first);
+    putLe16(&range[2], packetNumber - 1);
+    rangeCount++;
+  }
+  
+  if (rangeCount == 0) {
+    return;
+  }
+  nack[0] = NACK_OPCODE;
+  nack[1] = rangeCount;
+  
+  if (link.ackCharacteristic.write(nack, NACK_HEADER_SIZE + rangeCount * NACK_RANGE_SIZE)) {
+    Serial.print("NACK sent on link ");
+    Serial.print(link.connHandle);
+    Serial.print(" (round ");
+    Serial.print(link.nackRounds);
+    Serial.print("): ");
+    Serial.print(link.receivedPackets);
+    Serial.print("/");
+    Serial.print(link.expectedPackets);
+    Serial.println(" packets received");
+  } else {
+    Serial.println("Failed to send NACK");
+  }
+}
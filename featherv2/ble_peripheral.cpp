@@ -1,13 +1,20 @@
 #include "BLE_Peripheral.h"
 #include <Adafruit_LittleFS.h>
 #include <InternalFileSystem.h>
-extern void loadDataFromFlash(DataPoint* dataBuffer, int numDataPoints);
+extern int loadDataFromFlash(DataPoint* dataBuffer, int maxDataPoints, uint32_t fromSequence,
+                             uint32_t& firstSequence);
+extern void acknowledgeRecords(uint32_t lastSequence);
+extern uint32_t nextSequence;
+extern uint32_t ackedSequence;
 
 
 // Configuration
 const char* DEVICE_NAME = "nRF_01";
-const int NUM_DATA_POINTS = 200;
+const int NUM_DATA_POINTS = MAX_BATCH_POINTS;   // Most records sent in one batch
 const unsigned long SEND_INTERVAL = 10000; // 10 seconds
+const uint8_t NOTIFY_QUEUE_SIZE = 8;        // Notifications the SoftDevice may hold in flight
+const uint8_t CONN_EVENT_LENGTH = 6;        // 6 * 1.25ms = 7.5ms connection events
+const uint8_t PACKET_FORMAT = PACKET_FORMAT_DELTA;  // Delta + varint records, ~2-3 bytes per point
 
 // BLE objects
 BLEService dataService(SERVICE_UUID);
@@ -17,18 +24,58 @@ BLECharacteristic ackCharacteristic(ACK_CHARACTERISTIC_UUID);
 // State variables
 DataPoint dataBuffer[500];
 bool isConnected = false;
+uint16_t connHandle = BLE_CONN_HANDLE_INVALID;
 bool isSending = false;
 unsigned long lastSendTime = 0;
 uint32_t lastAckTimestamp = 0;
 bool hasNewTimestamp = false;
 
+// Batch transfer state, advanced by pumpDataBatch()
+int batchPointCount = 0;
+uint32_t batchFirstSequence = 0;          // Sequence number of dataBuffer[0]
+int batchPayloadSize = 0;
+int batchTotalPackets = 0;
+// First point of each packet, so any packet can be re-encoded for a retransmission
+int batchPacketStart[MAX_BATCH_PACKETS + 1];
+int batchNextPacket = 0;
+// Packets the central reported missing, bit (packetNumber - 1)
+volatile uint8_t resendBitmap[MAX_BATCH_PACKETS / 8];
+// Where the nest asked the next batch to start, set from the ACK characteristic
+volatile uint32_t syncFromSequence = 0;
+volatile bool syncRequested = false;
+// The nest ACKed the batch; its records are pruned from the main loop
+volatile bool batchAcked = false;
+
+// Backlog status advertised in the scan response
+bool needsTimeSync = true;
+AdvStatus advertisedStatus = {0, 0, 0};
+// The newest records, consecutive up to recentLastSequence, so a small backlog
+// goes into the scan response without reading flash
+DataPoint recentRecords[MAX_ADV_INLINE_RECORDS];
+int recentRecordCount = 0;
+uint32_t recentLastSequence = 0;
+
+// One credit per free notification slot in the SoftDevice TX queue,
+// returned by BLE_GATTS_EVT_HVN_TX_COMPLETE
+SemaphoreHandle_t txCreditSemaphore = NULL;
+// Wakes the main loop when the link has room for more data or an ACK arrived
+SemaphoreHandle_t bleEventSemaphore = NULL;
+
 void initBLE() {
+  // Allow the full 247-byte ATT MTU, long connection events and a deep
+  // notification queue so the link stays busy. Must be configured before begin().
+  Bluefruit.configPrphConn(BLE_GATT_ATT_MTU_MAX, CONN_EVENT_LENGTH, NOTIFY_QUEUE_SIZE,
+                           BLE_GATTC_WRITE_CMD_TX_QUEUE_SIZE_DEFAULT);
   Bluefruit.begin();
   Bluefruit.setTxPower(0);
   Bluefruit.setName(DEVICE_NAME);
   
   Bluefruit.Periph.setConnectCallback(connectCallback);
   Bluefruit.Periph.setDisconnectCallback(disconnectCallback);
+  
+  txCreditSemaphore = xSemaphoreCreateCounting(NOTIFY_QUEUE_SIZE, NOTIFY_QUEUE_SIZE);
+  bleEventSemaphore = xSemaphoreCreateBinary();
+  Bluefruit.setEventCallback(bleEventCallback);
 }
 
 void setupService() {
@@ -40,22 +87,139 @@ void setupService() {
   
   ackCharacteristic.setProperties(CHR_PROPS_WRITE);
   ackCharacteristic.setPermission(SECMODE_NO_ACCESS, SECMODE_OPEN);
+  ackCharacteristic.setMaxLen(MAX_NACK_SIZE);
   ackCharacteristic.setWriteCallback(ackCallback);
   ackCharacteristic.begin();
 }
 
 void startAdvertising() {
+  // No TX power field: without it the complete name fits next to the
+  // 128-bit UUID, so a nest can tell feathers apart without connecting
   Bluefruit.Advertising.addFlags(BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE);
-  Bluefruit.Advertising.addTxPower();
   Bluefruit.Advertising.addService(dataService);
   Bluefruit.Advertising.addName();
   
+  // The advertising packet is full, the backlog status (and a small backlog
+  // itself) goes in the scan response
+  updateAdvertisedStatus(needsTimeSync);
+  
   Bluefruit.Advertising.restartOnDisconnect(true);
   Bluefruit.Advertising.setInterval(32, 244);
   Bluefruit.Advertising.setFastTimeout(30);
   Bluefruit.Advertising.start(0);
 }
 
+void updateAdvertisedStatus(bool timeSyncNeeded) {
+  needsTimeSync = timeSyncNeeded;
+  
+  AdvStatus status;
+  status.flags = needsTimeSync ? ADV_FLAG_NEEDS_TIME_SYNC : 0;
+  status.pendingRecords = min(nextSequence - 1 - ackedSequence, (uint32_t)0xFFFF);
+  status.lastSequence = nextSequence - 1;
+  
+  if (Bluefruit.ScanResponse.count() > 0 && status.flags == advertisedStatus.flags &&
+      status.pendingRecords == advertisedStatus.pendingRecords &&
+      status.lastSequence == advertisedStatus.lastSequence) {
+    return;
+  }
+  advertisedStatus = status;
+  
+  uint8_t data[MAX_ADV_STATUS_SIZE];
+  size_t len = encodeAdvStatus(data, status);
+  
+  // A handful of pending records fits in the scan response, so the nest can
+  // collect them during its scan instead of connecting
+  int inlineRecords = 0;
+  if (status.pendingRecords > 0 && status.pendingRecords <= MAX_ADV_INLINE_RECORDS) {
+    inlineRecords = pendingInlineRecords(status);
+    if (inlineRecords > 0) {
+      size_t recordsLen = encodeAdvRecords(&data[len], sizeof(data) - len,
+                                           &recentRecords[recentRecordCount - inlineRecords], inlineRecords);
+      if (recordsLen > 0) {
+        len += recordsLen;
+      } else {
+        inlineRecords = 0;
+      }
+    }
+  }
+  
+  setScanResponse(data, len);
+  
+  Serial.print("Advertising ");
+  Serial.print(status.pendingRecords);
+  Serial.print(" pending records up to #");
+  Serial.print(status.lastSequence);
+  Serial.print(", ");
+  Serial.print(inlineRecords);
+  Serial.print(" inline");
+  Serial.println(needsTimeSync ? ", needs time sync" : "");
+}
+
+int pendingInlineRecords(const AdvStatus& status) {
+  // The pending records are the newest ones; read from flash only when they
+  // are not all in RAM, after a reboot, and keep them for the next update
+  int count = status.pendingRecords;
+  if (recentRecordCount >= count && recentLastSequence == status.lastSequence) {
+    return count;
+  }
+  
+  uint32_t firstSequence;
+  recentRecordCount = loadDataFromFlash(recentRecords, MAX_ADV_INLINE_RECORDS, ackedSequence + 1, firstSequence);
+  recentLastSequence = firstSequence + recentRecordCount - 1;
+  // Only when they are exactly the pending records, the nest numbers them back from lastSequence
+  if (recentRecordCount != count || recentLastSequence != status.lastSequence) {
+    recentRecordCount = 0;
+    return 0;
+  }
+  return count;
+}
+
+void noteRecordLogged(uint32_t sequence, const DataPoint& point) {
+  // Keeps the newest MAX_ADV_INLINE_RECORDS, restarting at a gap
+  if (recentRecordCount > 0 && sequence != recentLastSequence + 1) {
+    recentRecordCount = 0;
+  }
+  if (recentRecordCount == MAX_ADV_INLINE_RECORDS) {
+    memmove(&recentRecords[0], &recentRecords[1], (MAX_ADV_INLINE_RECORDS - 1) * sizeof(DataPoint));
+    recentRecordCount--;
+  }
+  recentRecords[recentRecordCount++] = point;
+  recentLastSequence = sequence;
+}
+
+void setScanResponse(const uint8_t* data, size_t len) {
+  Bluefruit.ScanResponse.clearData();
+  Bluefruit.ScanResponse.addManufacturerData(data, len);
+  
+  // While connected it is picked up by restartOnDisconnect
+  if (!Bluefruit.Advertising.isRunning()) {
+    return;
+  }
+  
+  // The SoftDevice swaps payloads while advertising if they come in buffers
+  // other than the ones it is sending from, so two of each are used in turn.
+  // It has a single advertising set, handle 0 once Bluefruit configured it
+  static uint8_t advBuffers[2][BLE_GAP_ADV_SET_DATA_SIZE_MAX];
+  static uint8_t scanRspBuffers[2][BLE_GAP_ADV_SET_DATA_SIZE_MAX];
+  static int buffer = 0;
+  buffer ^= 1;
+  
+  memcpy(advBuffers[buffer], Bluefruit.Advertising.getData(), Bluefruit.Advertising.count());
+  memcpy(scanRspBuffers[buffer], Bluefruit.ScanResponse.getData(), Bluefruit.ScanResponse.count());
+  ble_gap_adv_data_t gapData;
+  gapData.adv_data.p_data = advBuffers[buffer];
+  gapData.adv_data.len = Bluefruit.Advertising.count();
+  gapData.scan_rsp_data.p_data = scanRspBuffers[buffer];
+  gapData.scan_rsp_data.len = Bluefruit.ScanResponse.count();
+  
+  uint8_t handle = 0;
+  if (sd_ble_gap_adv_set_configure(&handle, &gapData, NULL) != NRF_SUCCESS) {
+    // Fall back to a restart, which configures the new data from scratch
+    Bluefruit.Advertising.stop();
+    Bluefruit.Advertising.start(0);
+  }
+}
+
 void generateTestData() {
   for (int i = 0; i < NUM_DATA_POINTS; i++) {
     dataBuffer[i].val1 = random(0, 2);        // 0 or 1
@@ -66,19 +230,97 @@ void generateTestData() {
 
 
 
+int getNotifyPayload() {
+  // Fill each notification up to the negotiated MTU
+  uint16_t payload = 20;  // Default ATT MTU 23 - 3 bytes ATT header
+  BLEConnection* conn = Bluefruit.Connection(connHandle);
+  if (conn) {
+    payload = conn->getMtu() - 3;
+  }
+  return min(payload, (uint16_t)MAX_NOTIFY_PAYLOAD);
+}
+
+int planBatch(int numPoints) {
+  // Delta packets hold a variable number of points, so split the batch once
+  // up front; packet boundaries do not depend on the final packet count
+  uint8_t scratch[MAX_NOTIFY_PAYLOAD];
+  int packets = 0;
+  int point = 0;
+  
+  batchPacketStart[0] = 0;
+  while (point < numPoints && packets < MAX_BATCH_PACKETS) {
+    int pointsEncoded = 0;
+    encodeDataPacket(scratch, batchPayloadSize, PACKET_FORMAT, packets + 1, 0,
+                     batchFirstSequence + point, &dataBuffer[point], numPoints - point, pointsEncoded);
+    if (pointsEncoded == 0) {
+      break;
+    }
+    point += pointsEncoded;
+    batchPacketStart[++packets] = point;
+  }
+  
+  // Nothing to send is still one header-only packet, so the central
+  // completes the handshake and ACKs in a single round trip
+  if (packets == 0) {
+    batchPacketStart[++packets] = 0;
+  }
+  return packets;
+}
+
+bool sendPacket(int packet) {
+  uint8_t packetBuffer[MAX_NOTIFY_PAYLOAD];
+  
+  int firstPoint = batchPacketStart[packet];
+  int pointsInPacket = batchPacketStart[packet + 1] - firstPoint;
+  
+  int pointsEncoded = 0;
+  uint16_t packetSize = encodeDataPacket(packetBuffer, batchPayloadSize, PACKET_FORMAT,
+                                         packet + 1, batchTotalPackets, batchFirstSequence + firstPoint,
+                                         &dataBuffer[firstPoint], pointsInPacket, pointsEncoded);
+  return dataCharacteristic.notify(connHandle, packetBuffer, packetSize);
+}
+
 void sendDataBatch() {
   if (!isConnected || isSending) return;
   
   isSending = true;
   
-  // Load ALL data points, not just 5!
-  loadDataFromFlash(dataBuffer, NUM_DATA_POINTS);
+  // Resume where the nest asked, but never before the first unacknowledged
+  // record; a request past our newest record means the nest's cursor is stale
+  uint32_t fromSequence = ackedSequence + 1;
+  if (syncFromSequence > fromSequence && syncFromSequence <= nextSequence) {
+    fromSequence = syncFromSequence;
+  }
+  syncRequested = false;
+  
+  // Only the records that exist, the batch shrinks to a single packet when idle
+  batchPointCount = loadDataFromFlash(dataBuffer, NUM_DATA_POINTS, fromSequence, batchFirstSequence);
+  
+  batchPayloadSize = getNotifyPayload();
+  batchTotalPackets = planBatch(batchPointCount);
+  batchNextPacket = 0;
+  memset((void*)resendBitmap, 0, sizeof(resendBitmap));
   
-  const int totalPackets = NUM_DATA_POINTS;
+  Serial.print("Starting data transmission: ");
+  Serial.print(batchPointCount);
+  Serial.print(" points from #");
+  Serial.print(batchFirstSequence);
+  Serial.print(" in ");
+  Serial.print(batchTotalPackets);
+  Serial.print(" packets of up to ");
+  Serial.print(batchPayloadSize);
+  Serial.println(" bytes");
   
-  Serial.println("Starting data transmission...");
+  pumpDataBatch();
+}
+
+void pumpDataBatch() {
+  if (!isSending) return;
   
-  for (int packet = 0; packet < totalPackets; packet++) {
+  // Queue packets until the SoftDevice TX queue is full; TX-complete events
+  // hand the credits back and wake the main loop to continue
+  int packet;
+  while ((packet = nextPacketToSend()) >= 0) {
     if (!isConnected) {
       Serial.print("Connection lost during transmission at packet ");
       Serial.println(packet + 1);
@@ -86,14 +328,12 @@ void sendDataBatch() {
       return;
     }
     
-    DataPacket dataPacket;
-    dataPacket.packetNumber = packet + 1;
-    dataPacket.totalPackets = totalPackets;
-    dataPacket.pointsInPacket = 1;
-    dataPacket.points[0] = dataBuffer[packet];
+    if (xSemaphoreTake(txCreditSemaphore, 0) != pdTRUE) {
+      return;
+    }
     
-    bool notifyResult = dataCharacteristic.notify((uint8_t*)&dataPacket, sizeof(DataPacket));
-    if (!notifyResult) {
+    if (!sendPacket(packet)) {
+      xSemaphoreGive(txCreditSemaphore);
       Serial.print("Notify failed at packet ");
       Serial.println(packet + 1);
       Serial.println("Connection may have been lost during transmission");
@@ -101,72 +341,148 @@ void sendDataBatch() {
       return;
     }
     
+    if (packet < batchNextPacket) {
+      // handleNack() sets bits from the BLE task
+      taskENTER_CRITICAL();
+      resendBitmap[packet / 8] &= ~(1 << (packet % 8));
+      taskEXIT_CRITICAL();
+      Serial.print("Retransmitted packet ");
+      Serial.println(packet + 1);
+      continue;
+    }
+    batchNextPacket++;
+    
     // Check connection status periodically during transmission
-    if ((packet + 1) % 10 == 0) {
+    if (batchNextPacket % 10 == 0) {
       Serial.print("Transmission progress: ");
-      Serial.print(packet + 1);
+      Serial.print(batchNextPacket);
       Serial.print("/");
-      Serial.print(totalPackets);
+      Serial.print(batchTotalPackets);
       Serial.print(" - Connection active: ");
       Serial.println(isConnected ? "YES" : "NO");
     }
     
-    // Print progress every 50 packets
-    if ((packet + 1) % 50 == 0) {
-      Serial.print("Sent packet ");
-      Serial.print(packet + 1);
-      Serial.print("/");
-      Serial.println(totalPackets);
+    if (batchNextPacket == batchTotalPackets) {
+      Serial.println("All packets sent successfully, waiting for ACK...");
     }
-    
-    delay(90);  // 90ms delay: 100 packets × 90ms = 9 seconds (well under supervision timeout)
+  }
+}
+
+int nextPacketToSend() {
+  if (batchNextPacket < batchTotalPackets) {
+    return batchNextPacket;
   }
   
-  Serial.println("All packets sent successfully, waiting for ACK...");
+  // First pass done, resend whatever the central reported missing
+  for (int packet = 0; packet < batchTotalPackets; packet++) {
+    if (resendBitmap[packet / 8] & (1 << (packet % 8))) {
+      return packet;
+    }
+  }
+  return -1;
+}
+
+void waitForBLEEvent(unsigned long timeoutMs) {
+  xSemaphoreTake(bleEventSemaphore, pdMS_TO_TICKS(timeoutMs));
+}
+
+void bleEventCallback(ble_evt_t* evt) {
+  // Runs in the Bluefruit BLE task: only hand out credits and wake the loop
+  if (evt->header.evt_id == BLE_GATTS_EVT_HVN_TX_COMPLETE &&
+      evt->evt.gatts_evt.conn_handle == connHandle) {
+    for (uint8_t i = 0; i < evt->evt.gatts_evt.params.hvn_tx_complete.count; i++) {
+      xSemaphoreGive(txCreditSemaphore);
+    }
+    xSemaphoreGive(bleEventSemaphore);
+  }
 }
 
 void ackCallback(uint16_t conn_hdl, BLECharacteristic* chr, uint8_t* data, uint16_t len) {
-  if (len == sizeof(uint32_t)) {
-    lastAckTimestamp = *(uint32_t*)data;  // Store the timestamp
+  if (len == ACK_SIZE) {
+    lastAckTimestamp = getLe32(data);     // Store the timestamp
     hasNewTimestamp = true;               // Mark as new (optional)
     
     Serial.print("ACK received with timestamp: ");
     Serial.println(lastAckTimestamp);
     
     isSending = false;
+    batchAcked = true;
+    xSemaphoreGive(bleEventSemaphore);
+  } else if (len == SYNC_REQUEST_SIZE && data[0] == SYNC_OPCODE) {
+    syncFromSequence = getLe32(&data[1]);
+    syncRequested = true;
+    
+    Serial.print("Sync requested from sequence ");
+    Serial.println(syncFromSequence);
+    
+    xSemaphoreGive(bleEventSemaphore);
+  } else if (len >= NACK_HEADER_SIZE && data[0] == NACK_OPCODE) {
+    handleNack(data, len);
+  }
+}
+
+void handleNack(const uint8_t* data, uint16_t len) {
+  uint8_t rangeCount = data[1];
+  if (rangeCount > MAX_NACK_RANGES || len < NACK_HEADER_SIZE + rangeCount * NACK_RANGE_SIZE) {
+    Serial.println("Malformed NACK ignored");
+    return;
+  }
+  
+  for (int i = 0; i < rangeCount; i++) {
+    const uint8_t* range = &data[NACK_HEADER_SIZE + i * NACK_RANGE_SIZE];
+    int first = getLe16(&range[0]);
+    int last = getLe16(&range[2]);
+    
+    Serial.print("NACK for packets ");
+    Serial.print(first);
+    Serial.print("-");
+    Serial.println(last);
+    
+    // Packet numbers are 1-based, bitmap bits are 0-based. loop() clears
+    // bits as it resends, so each read-modify-write must not interleave.
+    taskENTER_CRITICAL();
+    for (int packet = max(first, 1); packet <= min(last, batchTotalPackets); packet++) {
+      resendBitmap[(packet - 1) / 8] |= 1 << ((packet - 1) % 8);
+    }
+    taskEXIT_CRITICAL();
   }
+  
+  xSemaphoreGive(bleEventSemaphore);
 }
 
 void connectCallback(uint16_t conn_handle) {
   isConnected = true;
+  connHandle = conn_handle;
   lastSendTime = millis();
   
-  Serial.println("Connection established, configuring parameters...");
+  // Fresh link: every notification slot in the TX queue is free
+  for (uint8_t i = 0; i < NOTIFY_QUEUE_SIZE; i++) {
+    xSemaphoreGive(txCreditSemaphore);
+  }
   
-  // Request connection parameters optimized for data transmission
-  // 100 packets × 90ms = 9 seconds transmission time
-  Serial.println("Requesting optimized connection parameters...");
+  Serial.println("Connection established, configuring parameters...");
   
-  // For Seeeduino, use the Connection class
+  // The central picks the connection interval; the peripheral asks for what
+  // the Particle central cannot request itself (2M PHY, data length)
   BLEConnection* conn = Bluefruit.Connection(conn_handle);
   if (conn) {
-    // Request faster connection interval for reliable data transfer
     bool result = conn->requestPHY();  // Request 2M PHY for faster transfer
     Serial.print("PHY request: ");
     Serial.println(result ? "SUCCESS" : "FAILED");
     
-    // Request connection parameter update - Seeeduino version takes 3 params
-    // conn_interval (units of 1.25ms), slave_latency, supervision_timeout (units of 10ms)
-    // 20 * 1.25ms = 25ms interval, 0 latency, 600 * 10ms = 6s timeout
-    bool result2 = conn->requestConnectionParameter(20, 0, 600);
-    Serial.print("Connection parameter request: ");
-    Serial.println(result2 ? "SUCCESS" : "FAILED");
+    // Larger MTU and data length let several points share one notification
+    bool mtuResult = conn->requestMtuExchange(BLE_GATT_ATT_MTU_MAX);
+    Serial.print("MTU exchange request: ");
+    Serial.println(mtuResult ? "SUCCESS" : "FAILED");
+    conn->requestDataLengthUpdate();
+    
+    Serial.print("Connection interval: ");
+    Serial.print(conn->getConnectionInterval() * 1.25);
+    Serial.println(" ms");
   } else {
     Serial.println("Failed to get connection object");
   }
   
-  delay(1000);  // Give time for parameters to be negotiated
-  
   Serial.println("Connection configured - ready for transmission");
 }
 
@@ -175,12 +491,30 @@ void disconnectCallback(uint16_t conn_handle, uint8_t reason) {
   Serial.println(reason);
   
   isConnected = false;
+  connHandle = BLE_CONN_HANDLE_INVALID;
   isSending = false;
+  
+  // The next nest sends its own sync request
+  syncFromSequence = 0;
+  syncRequested = false;
 }
 
 void handleBLELoop() {
-  if (isConnected && !isSending && (millis() - lastSendTime >= SEND_INTERVAL)) {
+  // Drop the records the last ACK covered before loading another batch. The
+  // sync request vouched for everything before the batch, so an empty batch
+  // still acknowledges up to its start.
+  if (batchAcked) {
+    batchAcked = false;
+    if (batchFirstSequence + batchPointCount > 1) {
+      acknowledgeRecords(batchFirstSequence + batchPointCount - 1);
+      updateAdvertisedStatus(needsTimeSync);
+    }
+  }
+  
+  // A sync request starts the batch right away, otherwise fall back to SEND_INTERVAL
+  if (isConnected && !isSending && (syncRequested || millis() - lastSendTime >= SEND_INTERVAL)) {
     sendDataBatch();
     lastSendTime = millis();
   }
+  pumpDataBatch();
 }
\ No newline at end of file
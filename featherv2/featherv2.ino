@@ -5,6 +5,7 @@
 
 bool timeSync = false;
 int32_t previousTime = -1;
+uint32_t timeBase = 0;  // Unix time at RTC tick 0, records are stored in absolute seconds
 
 // STAGE 3 VARIABLES
 unsigned long BLE_ATTEMPT_INTERVAL = 480; // 60 seconds * 8Hz
@@ -15,6 +16,10 @@ uint32_t oldTimeStamp = 0;
 
 bool timeStampStored = false;
 
+// Stage logic runs once per second, BLE uploads are pumped in between
+const unsigned long STAGE_INTERVAL = 1000;
+unsigned long lastStageTime = 0;
+
 void setup() {
   
   Wire.begin();
@@ -33,7 +38,8 @@ void setup() {
   configureFlash();
   deleteLogs("/time.txt");
   readLogs("/time.txt");
-  deleteLogs("/state.txt");
+  // Unacknowledged records survive a reboot, keep numbering after them
+  loadSequenceState();
 
   // Initialize BLE
   initBLE();
@@ -45,13 +51,23 @@ void setup() {
 
 void loop() {
 
+  // A nest may connect at any stage: answer its sync request, keep the
+  // notification queue full while a batch is in flight and prune what it ACKs
+  handleBLELoop();
+
+  // Sleep until the next stage tick, waking early on BLE TX-complete events
+  unsigned long sinceLastStage = millis() - lastStageTime;
+  if (sinceLastStage < STAGE_INTERVAL) {
+    waitForBLEEvent(STAGE_INTERVAL - sinceLastStage);
+    return;
+  }
+  lastStageTime = millis();
+
   //STAGE 1: FEATHER LOCALLY STORES A TIMESTAMP FROM A NEST DEVICE TO FLASH
-  // Handle BLE operations
   if (!hasNewTimestamp) 
   {
     Serial.print("Latest timestamp: ");
     Serial.println(lastAckTimestamp);
-    handleBLELoop();
   }
   if (hasNewTimestamp && !timeStampStored) 
   {
@@ -59,19 +75,27 @@ void loop() {
       Serial.println(lastAckTimestamp);
       deleteLogs("/time.txt");
       writeLogEntry(lastAckTimestamp, 0, 0, 0, "/time.txt", 0);
+      timeBase = lastAckTimestamp;
       previousTime = 0;
       resetRTC();
       readLogs("/time.txt");
       timeStampStored = true;
+      updateAdvertisedStatus(false);
   }
 
   // STAGE 2: Feather begins to collect equipment state data with time relative to timestamp
-  if (timeStampStored && motionDetected && !stage3Active) {
+  // Records keep their own sequence numbers, so logging continues while stage 3 uploads
+  if (timeStampStored && motionDetected) {
     motionDetected = false;
     Serial.println("STAGE 2");
     int32_t time = readRTC();
     //int state = checkForStateChange();
-    writeLogEntry(0, state, previousTime, time, "/state.txt", 1);
+    // Convert 8Hz RTC ticks to absolute Unix seconds
+    DataPoint record = {(uint8_t)state, timeBase + previousTime / 8, timeBase + time / 8};
+    if (appendStateRecord(record.val2, record.val3, record.val1)) {
+      noteRecordLogged(nextSequence - 1, record);
+    }
+    updateAdvertisedStatus(false);
     previousTime = time;
     Serial.println("=== Motion Event Logged ===");
     readLogs("/state.txt");
@@ -92,19 +116,17 @@ void loop() {
     Serial.print(lastAckTimestamp);
     Serial.print(",");
     Serial.println(oldTimeStamp);
-    handleBLELoop();
     if (oldTimeStamp != lastAckTimestamp)
     {
       Serial.println("DATA SENT - CYCLE COMPLETE");
       stage3Active = false;
-      // Clear old data files
+      // Acknowledged records are already pruned, only the time base is reset
       deleteLogs("/time.txt");
-      deleteLogs("/state.txt");
-      // Reset to wait for NEW timestamp from central
-      hasNewTimestamp = false;  // Wait for fresh timestamp
+      // The ACK carried a fresh timestamp, stage 1 stores it as the new time
+      // base without another connection
       timeStampStored = false;
       resetRTC();
-      Serial.println("Waiting for new timestamp from central...");
+      Serial.println("Storing timestamp from the ACK as the new time base...");
     }
 /*    else if (oldTimeStamp == lastAckTimestamp && readRTC()-lastBLEAttempt >= 240 && sentFlag == true)
     {
@@ -115,7 +137,4 @@ void loop() {
     }*/
 
   }
-  
-  
-  delay(1000);
 }
\ No newline at end of file
@@ -22,74 +22,6 @@ uint32_t sessionStartTime = 0;
 uint8_t currentState = 0;
 
 
-void loadDataFromFlash(DataPoint* dataBuffer, int numDataPoints) {
-  Serial.println("Loading motion data from flash...");
-  memset(dataBuffer, 0, sizeof(DataPoint) * numDataPoints);
-  
-  int dataCount = 0;
-  uint32_t baseTimestamp = 0;
-  
-  // Read base timestamp from time.txt
-  logFile = InternalFS.open("/time.txt", FILE_O_READ);
-  if (logFile) {
-    String timestampLine = logFile.readStringUntil('\n');
-    baseTimestamp = timestampLine.toInt();
-    logFile.close();
-    Serial.print("Base timestamp: ");
-    Serial.println(baseTimestamp);
-  }
-    // Read state log file
-  logFile = InternalFS.open("/state.txt", FILE_O_READ);
-  if (!logFile) {
-    Serial.println("No state data found, using zeros");
-    return;
-  }
-  
-  // Parse each line from state.txt
-  while (logFile.available() && dataCount < numDataPoints) {
-    String line = logFile.readStringUntil('\n');
-    line.trim();
-  
-      if (line.length() > 0) {
-      // Parse CSV format: startTime,endTime,state
-      int firstComma = line.indexOf(',');
-      int secondComma = line.indexOf(',', firstComma + 1);
-      
-      if (firstComma != -1 && secondComma != -1) {
-        uint32_t startTime = line.substring(0, firstComma).toInt();
-        uint32_t endTime = line.substring(firstComma + 1, secondComma).toInt();
-        uint8_t state = line.substring(secondComma + 1).toInt();
-        
-        // Convert to DataPoint format
-        dataBuffer[dataCount].val1 = state;                        // Motion state
-        dataBuffer[dataCount].val2 = baseTimestamp + (startTime / 8); // Absolute start time (convert 8Hz ticks to seconds)
-        dataBuffer[dataCount].val3 = baseTimestamp + (endTime / 8);   // Absolute end time (convert 8Hz ticks to seconds)
-        dataCount++;
-        
-        Serial.print("Loaded motion event: State=");
-        Serial.print(state);
-        Serial.print(", Start=");
-        Serial.print(startTime);
-        Serial.print(", End=");
-        Serial.println(endTime);
-      }
-    }
-  }
-  
-  logFile.close();
-  
-  Serial.print("Loaded ");
-  Serial.print(dataCount);
-  Serial.println(" motion events from flash");
-  
-// Fill remaining slots with actual zeros
-for (int i = dataCount; i < numDataPoints; i++) {
-  dataBuffer[i].val1 = 0;
-  dataBuffer[i].val2 = 0;  // Change this to 0
-  dataBuffer[i].val3 = 0;  // Change this to 0
-}
-  
-}
 // Function declarations
 void configureFlash()
 {
@@ -202,4 +134,172 @@ bool writeLogEntry(uint32_t timestamp, uint8_t state, uint32_t startTime,
   return writeData(buffer, filename);
 }
 
+// Every stored record carries a sequence number that keeps counting across
+// batches and reboots. /seq.txt holds "nextSequence,ackedSequence"; records up
+// to ackedSequence reached a nest and are pruned from /state.txt.
+const char* STATE_FILENAME = "/state.txt";
+const char* STATE_TEMP_FILENAME = "/state.tmp";
+const char* SEQUENCE_FILENAME = "/seq.txt";
+uint32_t nextSequence = 1;
+uint32_t ackedSequence = 0;
+
+void loadSequenceState() {
+  logFile = InternalFS.open(SEQUENCE_FILENAME, FILE_O_READ);
+  if (logFile) {
+    String line = logFile.readStringUntil('\n');
+    logFile.close();
+    int comma = line.indexOf(',');
+    if (comma != -1) {
+      nextSequence = line.substring(0, comma).toInt();
+      ackedSequence = line.substring(comma + 1).toInt();
+    }
+  }
+  if (nextSequence <= ackedSequence) {
+    nextSequence = ackedSequence + 1;
+  }
+  
+  Serial.print("Next record sequence: ");
+  Serial.print(nextSequence);
+  Serial.print(", acknowledged up to: ");
+  Serial.println(ackedSequence);
+}
+
+bool saveSequenceState() {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%lu,%lu", nextSequence, ackedSequence);
+  return writeData(buffer, SEQUENCE_FILENAME, false);
+}
+
+// Appends one motion interval (absolute Unix seconds) under the next sequence number
+bool appendStateRecord(uint32_t startTime, uint32_t endTime, uint8_t state) {
+  uint32_t sequence = nextSequence++;
+  
+  // Persist the counter first: a crash in between costs a gap, never a reused number
+  if (!saveSequenceState()) {
+    return false;
+  }
+  
+  char buffer[48];
+  snprintf(buffer, sizeof(buffer), "%lu,%lu,%lu,%u", sequence, startTime, endTime, state);
+  return writeData(buffer, STATE_FILENAME, true);
+}
+
+// Parses "sequence,startTime,endTime,state"
+bool parseStateRecord(String& line, uint32_t& sequence, DataPoint& point) {
+  int firstComma = line.indexOf(',');
+  int secondComma = line.indexOf(',', firstComma + 1);
+  int thirdComma = line.indexOf(',', secondComma + 1);
+  if (firstComma == -1 || secondComma == -1 || thirdComma == -1) {
+    return false;
+  }
+  
+  sequence = line.substring(0, firstComma).toInt();
+  point.val2 = line.substring(firstComma + 1, secondComma).toInt();
+  point.val3 = line.substring(secondComma + 1, thirdComma).toInt();
+  point.val1 = line.substring(thirdComma + 1).toInt();
+  return true;
+}
+
+// Loads up to maxDataPoints consecutive records starting at fromSequence and
+// returns how many were read; firstSequence is the sequence of dataBuffer[0]
+int loadDataFromFlash(DataPoint* dataBuffer, int maxDataPoints, uint32_t fromSequence,
+                      uint32_t& firstSequence) {
+  Serial.print("Loading motion data from flash, from sequence ");
+  Serial.println(fromSequence);
+  
+  int dataCount = 0;
+  firstSequence = fromSequence;
+  
+  logFile = InternalFS.open(STATE_FILENAME, FILE_O_READ);
+  if (!logFile) {
+    Serial.println("No state data found");
+    return 0;
+  }
+  
+  while (logFile.available() && dataCount < maxDataPoints) {
+    String line = logFile.readStringUntil('\n');
+    line.trim();
+    
+    uint32_t sequence;
+    DataPoint point;
+    if (line.length() == 0 || !parseStateRecord(line, sequence, point) || sequence < fromSequence) {
+      continue;
+    }
+    
+    // Packets number points by firstSequence + index, so a gap ends the batch
+    if (dataCount == 0) {
+      firstSequence = sequence;
+    } else if (sequence != firstSequence + dataCount) {
+      break;
+    }
+    
+    dataBuffer[dataCount++] = point;
+    
+    Serial.print("Loaded motion event #");
+    Serial.print(sequence);
+    Serial.print(": State=");
+    Serial.print(point.val1);
+    Serial.print(", Start=");
+    Serial.print(point.val2);
+    Serial.print(", End=");
+    Serial.println(point.val3);
+  }
+  
+  logFile.close();
+  
+  Serial.print("Loaded ");
+  Serial.print(dataCount);
+  Serial.println(" motion events from flash");
+  
+  return dataCount;
+}
+
+// A nest ACKed every record up to lastSequence: remember it and drop them from flash
+void acknowledgeRecords(uint32_t lastSequence) {
+  if (lastSequence <= ackedSequence || lastSequence >= nextSequence) {
+    return;
+  }
+  ackedSequence = lastSequence;
+  saveSequenceState();
+  
+  // Copy the unacknowledged records to a new file, then swap it in
+  logFile = InternalFS.open(STATE_FILENAME, FILE_O_READ);
+  if (!logFile) {
+    return;
+  }
+  InternalFS.remove(STATE_TEMP_FILENAME);
+  File tempFile(InternalFS);
+  tempFile = InternalFS.open(STATE_TEMP_FILENAME, FILE_O_WRITE);
+  if (!tempFile) {
+    logFile.close();
+    Serial.println("ERROR: Failed to open file for pruning!");
+    return;
+  }
+  
+  int kept = 0;
+  while (logFile.available()) {
+    String line = logFile.readStringUntil('\n');
+    line.trim();
+    
+    uint32_t sequence;
+    DataPoint point;
+    if (line.length() > 0 && parseStateRecord(line, sequence, point) && sequence > ackedSequence) {
+      tempFile.println(line);
+      kept++;
+    }
+  }
+  logFile.close();
+  tempFile.flush();
+  tempFile.close();
+  
+  InternalFS.remove(STATE_FILENAME);
+  InternalFS.rename(STATE_TEMP_FILENAME, STATE_FILENAME);
+  
+  Serial.print("Records acknowledged up to #");
+  Serial.print(ackedSequence);
+  Serial.print(", ");
+  Serial.print(kept);
+  Serial.println(" still pending");
+}
+
 #endif // FLASH_STORAGE_H
\ No newline at end of file
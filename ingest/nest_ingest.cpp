@@ -0,0 +1,352 @@
+// nest_ingest: reads the gateway frames the nRF52 central streams in
+// BINARY_OUTPUT mode, from its USB serial port or from a capture file, and
+// writes every record once as CSV and/or one raw column file per field.
+// Records arriving out of order are kept; a record is only dropped as a
+// resend if its (feather, sequence) was written before, or if it is more
+// than DEDUP_WINDOW sequences behind that feather's newest record.
+//
+// Build (Linux, host compiler):
+//   g++ -O2 -std=c++17 -I../lib/nest-protocol/src nest_ingest.cpp -o nest_ingest
+//
+// Usage:
+//   nest_ingest [-o records.csv] [-c column_dir] [-r capture.bin] <serial port | capture file>
+//
+// -r saves the raw serial bytes, so a session can be decoded again offline to
+// benchmark the decoder. Without -o or -c the records are only counted.
+
+#include "nest_protocol.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define READ_BUFFER_SIZE    65536
+#define COLUMN_FLUSH_ROWS   65536
+// Sequences behind a feather's newest record that are still told apart from
+// resends. Retransmitted packets and resent batches arrive out of order, but
+// only within a batch or two (MAX_BATCH_POINTS each); anything older is
+// counted as too old and dropped.
+#define DEDUP_WINDOW        4096
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+struct IngestStats {
+    uint64_t bytesRead;
+    uint64_t framesDecoded;
+    uint64_t framesRejected;    // COBS or CRC errors, text lines, truncated frames
+    uint64_t recordsWritten;
+    uint64_t recordsDuplicate;
+    uint64_t recordsTooOld;     // Further than DEDUP_WINDOW behind the feather's newest record
+};
+
+// Records written per feather: the newest sequence, and one bit per sequence
+// (sequence % DEDUP_WINDOW) for the DEDUP_WINDOW sequences up to it
+struct SequenceWindow {
+    uint32_t highest;
+    uint64_t seen[DEDUP_WINDOW / 64];
+};
+
+enum SequenceCheck {
+    SEQUENCE_NEW,
+    SEQUENCE_DUPLICATE,
+    SEQUENCE_TOO_OLD
+};
+
+// Raw little-endian column files: address.u64, sequence.u32, val1.u8, val2.u32, val3.u32
+struct ColumnWriter {
+    FILE* files[5];
+    std::vector<uint64_t> address;
+    std::vector<uint32_t> sequence;
+    std::vector<uint8_t> val1;
+    std::vector<uint32_t> val2;
+    std::vector<uint32_t> val3;
+};
+
+static bool openColumns(ColumnWriter& columns, const std::string& dir) {
+    static const char* names[5] = {"address.u64", "sequence.u32", "val1.u8", "val2.u32", "val3.u32"};
+    mkdir(dir.c_str(), 0755);
+    for (int i = 0; i < 5; i++) {
+        std::string path = dir + "/" + names[i];
+        columns.files[i] = fopen(path.c_str(), "wb");
+        if (columns.files[i] == NULL) {
+            fprintf(stderr, "Cannot create %s: %s\n", path.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+static void flushColumns(ColumnWriter& columns) {
+    fwrite(columns.address.data(), sizeof(uint64_t), columns.address.size(), columns.files[0]);
+    fwrite(columns.sequence.data(), sizeof(uint32_t), columns.sequence.size(), columns.files[1]);
+    fwrite(columns.val1.data(), sizeof(uint8_t), columns.val1.size(), columns.files[2]);
+    fwrite(columns.val2.data(), sizeof(uint32_t), columns.val2.size(), columns.files[3]);
+    fwrite(columns.val3.data(), sizeof(uint32_t), columns.val3.size(), columns.files[4]);
+    columns.address.clear();
+    columns.sequence.clear();
+    columns.val1.clear();
+    columns.val2.clear();
+    columns.val3.clear();
+}
+
+struct Ingest {
+    FILE* csv;
+    ColumnWriter* columns;
+    FILE* capture;
+    // Sequences written per feather. Feathers number records consecutively
+    // and resend unacknowledged ones, so a sequence seen before is a resend.
+    std::unordered_map<uint64_t, SequenceWindow> written;
+    IngestStats stats;
+
+    // Encoded bytes of the frame being received
+    uint8_t frame[GATEWAY_MAX_ENCODED];
+    size_t frameLen;
+    bool frameOverflow;
+};
+
+// Marks sequence as written unless it was already, or is too old to tell
+static SequenceCheck checkSequence(SequenceWindow& window, uint32_t sequence) {
+    if (sequence > window.highest) {
+        // Slide the window up, forgetting the sequences it leaves behind
+        if (sequence - window.highest >= DEDUP_WINDOW) {
+            memset(window.seen, 0, sizeof(window.seen));
+        } else {
+            for (uint32_t s = window.highest + 1; s != sequence; s++) {
+                window.seen[(s % DEDUP_WINDOW) / 64] &= ~(1ULL << (s % 64));
+            }
+        }
+        window.highest = sequence;
+    } else if (window.highest - sequence >= DEDUP_WINDOW) {
+        return SEQUENCE_TOO_OLD;
+    } else if (window.seen[(sequence % DEDUP_WINDOW) / 64] & (1ULL << (sequence % 64))) {
+        return SEQUENCE_DUPLICATE;
+    }
+    window.seen[(sequence % DEDUP_WINDOW) / 64] |= 1ULL << (sequence % 64);
+    return SEQUENCE_NEW;
+}
+
+static void handleFrame(Ingest& ingest, uint8_t* data, size_t len) {
+    GatewayFrame frame;
+    size_t decodedLen = cobsDecode(data, data, len);
+    if (decodedLen == 0 || !decodeGatewayFrame(data, decodedLen, frame)) {
+        ingest.stats.framesRejected++;
+        return;
+    }
+    ingest.stats.framesDecoded++;
+
+    uint64_t address = 0;
+    for (int i = GATEWAY_ADDRESS_SIZE - 1; i >= 0; i--) {
+        address = (address << 8) | frame.address[i];
+    }
+
+    // Value-initialised for a new feather: nothing seen, sequences start at 1
+    SequenceWindow& window = ingest.written[address];
+    for (int i = 0; i < frame.pointCount; i++) {
+        uint32_t sequence = frame.firstSequence + i;
+        SequenceCheck check = checkSequence(window, sequence);
+        if (check == SEQUENCE_DUPLICATE) {
+            ingest.stats.recordsDuplicate++;
+            continue;
+        }
+        if (check == SEQUENCE_TOO_OLD) {
+            ingest.stats.recordsTooOld++;
+            continue;
+        }
+
+        const uint8_t* point = frame.points + i * DATA_POINT_WIRE_SIZE;
+        uint8_t val1 = point[0];
+        uint32_t val2 = getLe32(&point[1]);
+        uint32_t val3 = getLe32(&point[5]);
+
+        if (ingest.csv != NULL) {
+            fprintf(ingest.csv, "%012llx,%u,%u,%u,%u\n", (unsigned long long)address,
+                    sequence, val1, val2, val3);
+        }
+        if (ingest.columns != NULL) {
+            ColumnWriter& columns = *ingest.columns;
+            columns.address.push_back(address);
+            columns.sequence.push_back(sequence);
+            columns.val1.push_back(val1);
+            columns.val2.push_back(val2);
+            columns.val3.push_back(val3);
+            if (columns.sequence.size() >= COLUMN_FLUSH_ROWS) {
+                flushColumns(columns);
+            }
+        }
+
+        ingest.stats.recordsWritten++;
+    }
+}
+
+// Splits the byte stream at the delimiters; frames that outgrow the buffer
+// (usually debug text) are dropped up to the next delimiter
+static void consumeBytes(Ingest& ingest, const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != GATEWAY_DELIMITER) {
+            if (ingest.frameLen < sizeof(ingest.frame)) {
+                ingest.frame[ingest.frameLen++] = data[i];
+            } else {
+                ingest.frameOverflow = true;
+            }
+            continue;
+        }
+
+        if (ingest.frameOverflow) {
+            ingest.stats.framesRejected++;
+        } else if (ingest.frameLen > 0) {
+            handleFrame(ingest, ingest.frame, ingest.frameLen);
+        }
+        ingest.frameLen = 0;
+        ingest.frameOverflow = false;
+    }
+}
+
+// Raw mode so no byte is translated or swallowed; the USB CDC port ignores the baud rate
+static bool configureSerial(int fd) {
+    struct termios tty;
+    if (tcgetattr(fd, &tty) != 0) {
+        return false;
+    }
+    cfmakeraw(&tty);
+    cfsetspeed(&tty, B115200);
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tty) == 0;
+}
+
+static double secondsSince(const struct timespec& start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-o records.csv] [-c column_dir] [-r capture.bin] <serial port | capture file>\n", name);
+}
+
+int main(int argc, char** argv) {
+    const char* csvPath = NULL;
+    const char* columnDir = NULL;
+    const char* capturePath = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:c:r:")) != -1) {
+        switch (opt) {
+            case 'o': csvPath = optarg; break;
+            case 'c': columnDir = optarg; break;
+            case 'r': capturePath = optarg; break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char* inputPath = argv[optind];
+
+    int fd = open(inputPath, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", inputPath, strerror(errno));
+        return 1;
+    }
+    bool isSerial = isatty(fd);
+    if (isSerial && !configureSerial(fd)) {
+        fprintf(stderr, "Cannot configure %s: %s\n", inputPath, strerror(errno));
+        return 1;
+    }
+
+    static Ingest ingest;
+    ColumnWriter columns;
+    if (csvPath != NULL) {
+        ingest.csv = fopen(csvPath, "w");
+        if (ingest.csv == NULL) {
+            fprintf(stderr, "Cannot create %s: %s\n", csvPath, strerror(errno));
+            return 1;
+        }
+        fprintf(ingest.csv, "address,sequence,val1,val2,val3\n");
+    }
+    if (columnDir != NULL) {
+        if (!openColumns(columns, columnDir)) {
+            return 1;
+        }
+        ingest.columns = &columns;
+    }
+    if (capturePath != NULL) {
+        ingest.capture = fopen(capturePath, "wb");
+        if (ingest.capture == NULL) {
+            fprintf(stderr, "Cannot create %s: %s\n", capturePath, strerror(errno));
+            return 1;
+        }
+    }
+
+    // Ctrl-C ends a serial session cleanly, with the files flushed
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    static uint8_t buffer[READ_BUFFER_SIZE];
+    while (!stopRequested) {
+        ssize_t len = read(fd, buffer, sizeof(buffer));
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Read failed: %s\n", strerror(errno));
+            break;
+        }
+        if (len == 0) {
+            break;  // End of the capture file, or the central was unplugged
+        }
+
+        ingest.stats.bytesRead += len;
+        if (ingest.capture != NULL) {
+            fwrite(buffer, 1, len, ingest.capture);
+        }
+        consumeBytes(ingest, buffer, len);
+    }
+    double elapsed = secondsSince(start);
+    close(fd);
+
+    if (ingest.csv != NULL) {
+        fclose(ingest.csv);
+    }
+    if (ingest.columns != NULL) {
+        flushColumns(columns);
+        for (int i = 0; i < 5; i++) {
+            fclose(columns.files[i]);
+        }
+    }
+    if (ingest.capture != NULL) {
+        fclose(ingest.capture);
+    }
+
+    const IngestStats& stats = ingest.stats;
+    fprintf(stderr, "%llu bytes, %llu frames (%llu rejected), %llu records written, %llu duplicates, "
+            "%llu too old, %zu feathers\n",
+            (unsigned long long)stats.bytesRead, (unsigned long long)stats.framesDecoded,
+            (unsigned long long)stats.framesRejected, (unsigned long long)stats.recordsWritten,
+            (unsigned long long)stats.recordsDuplicate, (unsigned long long)stats.recordsTooOld,
+            ingest.written.size());
+    if (elapsed > 0) {
+        fprintf(stderr, "%.3f s: %.1f MB/s, %.0f frames/s, %.0f records/s\n", elapsed,
+                stats.bytesRead / elapsed / 1e6, stats.framesDecoded / elapsed,
+                (stats.recordsWritten + stats.recordsDuplicate + stats.recordsTooOld) / elapsed);
+    }
+    return 0;
+}
@@ -0,0 +1,510 @@
+#ifndef NEST_PROTOCOL_H
+#define NEST_PROTOCOL_H
+
+// Wire protocol shared by the feather (featherv2), the Particle nest (src)
+// and the nRF52 central (central). Header-only and free of platform
+// includes so it also builds on a host compiler.
+
+#include <stdint.h>
+#include <stddef.h>
+
+// BLE UUIDs
+#define SERVICE_UUID                   "12345678-1234-1234-1234-123456789abc"
+#define DATA_CHARACTERISTIC_UUID       "87654321-4321-4321-4321-cba987654321"
+#define ACK_CHARACTERISTIC_UUID        "11223344-5566-7788-99aa-bbccddeeff00"
+
+// Bumped whenever the packet layout changes; receivers drop other versions
+#define NEST_PROTOCOL_VERSION          3
+
+// How the points after the packet header are encoded
+#define PACKET_FORMAT_RAW              0   // DataPointWire per point
+#define PACKET_FORMAT_DELTA            1   // Base timestamp + zig-zag varint deltas
+
+// Largest ATT MTU we negotiate, and the notification payload it leaves
+#define NEST_MAX_ATT_MTU               247
+#define MAX_NOTIFY_PAYLOAD             (NEST_MAX_ATT_MTU - 3)
+
+// ACK characteristic writes: a 4-byte timestamp acknowledges the complete batch,
+// a NACK is [NACK_OPCODE][range count][first, last packet number (uint16 LE)]...
+// and a sync request [SYNC_OPCODE][first sequence (uint32 LE)] asks the feather
+// to start its batch there (0: everything not yet acknowledged)
+#define ACK_SIZE                       4
+#define SYNC_OPCODE                    0x53
+#define SYNC_REQUEST_SIZE              5
+#define NACK_OPCODE                    0x4E
+#define NACK_HEADER_SIZE               2
+#define NACK_RANGE_SIZE                4
+#define MAX_NACK_RANGES                4
+#define MAX_NACK_SIZE                  (NACK_HEADER_SIZE + MAX_NACK_RANGES * NACK_RANGE_SIZE)
+#define MAX_BATCH_PACKETS              256
+// Most records a feather puts in one batch, receivers size their buffers by it
+#define MAX_BATCH_POINTS               200
+
+// Manufacturer-specific data in the feather's scan response, so a nest can
+// tell from a scan whether a connection would transfer anything
+#define NEST_COMPANY_ID                0xFFFF  // Bluetooth SIG ID reserved for internal use
+#define ADV_FLAG_NEEDS_TIME_SYNC       0x01    // No time base yet, records cannot be logged
+#define ADV_STATUS_SIZE                10
+// A small backlog rides along after the status: the delta payload of all
+// pending records, so the nest collects them without connecting. 31-byte
+// legacy scan response minus the AD length/type bytes.
+#define MAX_ADV_STATUS_SIZE            29
+#define MAX_ADV_INLINE_RECORDS         8
+
+// In-memory data point, naturally aligned for the firmware
+struct DataPoint {
+    uint8_t val1;   // 8 bits: state 0-255
+    uint32_t val2;  // 32 bits: start, Unix seconds
+    uint32_t val3;  // 32 bits: end, Unix seconds
+};
+
+// On-air layouts. Every multi-byte field is little-endian; always go through
+// the encode/decode helpers below instead of casting received buffers.
+struct __attribute__((packed)) DataPacketHeader {
+    uint8_t version;          // NEST_PROTOCOL_VERSION
+    uint8_t format;           // PACKET_FORMAT_*
+    uint16_t packetNumber;    // 1-based
+    uint16_t totalPackets;
+    uint8_t pointsInPacket;   // Points encoded after the header
+    uint32_t firstSequence;   // Record sequence number of the first point
+};
+
+struct __attribute__((packed)) DataPointWire {
+    uint8_t val1;
+    uint32_t val2;
+    uint32_t val3;
+};
+
+static_assert(sizeof(DataPacketHeader) == 11, "DataPacketHeader must be 11 bytes on the wire");
+static_assert(sizeof(DataPointWire) == 9, "DataPointWire must be 9 bytes on the wire");
+
+// PACKET_FORMAT_DELTA payload, each packet decodable on its own:
+//   base (uint32 LE)  start time of the first point
+//   per point:        varint((zigzag(start - previous end) << 2) | state)
+//                     [state byte, only when the 2-bit state is DELTA_STATE_ESCAPE]
+//                     varint(zigzag(end - start))
+// "previous end" is the base for the first point. Consecutive state intervals
+// share their boundary, so most points take 2-3 bytes instead of 9.
+#define DELTA_BASE_SIZE                4
+#define DELTA_STATE_ESCAPE             3
+#define MAX_VARINT_SIZE                5   // 34 bits of (zigzag << 2)
+#define MAX_DELTA_POINT_SIZE           (2 * MAX_VARINT_SIZE + 1)
+
+#define DATA_PACKET_HEADER_SIZE        sizeof(DataPacketHeader)
+#define DATA_POINT_WIRE_SIZE           sizeof(DataPointWire)
+
+// Little-endian helpers
+
+static inline void putLe16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+}
+
+static inline void putLe32(uint8_t* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+static inline uint16_t getLe16(const uint8_t* in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static inline uint32_t getLe32(const uint8_t* in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) |
+           ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// Scan response status
+
+struct AdvStatus {
+    uint8_t flags;              // ADV_FLAG_*
+    uint16_t pendingRecords;    // Records not yet acknowledged by a nest
+    uint32_t lastSequence;      // Newest record, changes whenever one is logged
+    bool recordsInline;         // Decoded only: the pending records follow the status
+};
+
+// [company id][version][flags][pending (uint16 LE)][last sequence (uint32 LE)]
+static inline size_t encodeAdvStatus(uint8_t* out, const AdvStatus& status) {
+    putLe16(&out[0], NEST_COMPANY_ID);
+    out[2] = NEST_PROTOCOL_VERSION;
+    out[3] = status.flags;
+    putLe16(&out[4], status.pendingRecords);
+    putLe32(&out[6], status.lastSequence);
+    return ADV_STATUS_SIZE;
+}
+
+// Returns false for other companies' data and other protocol versions
+static inline bool decodeAdvStatus(const uint8_t* in, size_t len, AdvStatus& status) {
+    if (len < ADV_STATUS_SIZE || getLe16(&in[0]) != NEST_COMPANY_ID || in[2] != NEST_PROTOCOL_VERSION) {
+        return false;
+    }
+    status.flags = in[3];
+    status.pendingRecords = getLe16(&in[4]);
+    status.lastSequence = getLe32(&in[6]);
+    status.recordsInline = len > ADV_STATUS_SIZE && status.pendingRecords > 0 &&
+                           status.pendingRecords <= MAX_ADV_INLINE_RECORDS;
+    return true;
+}
+
+// Varints (LEB128, least significant group first)
+
+static inline uint32_t zigzagEncode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t zigzagDecode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static inline size_t putVarint(uint8_t* out, uint64_t value) {
+    size_t len = 0;
+    while (value >= 0x80) {
+        out[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+    return len;
+}
+
+// Returns bytes consumed, 0 if the varint is truncated or too long
+static inline size_t getVarint(const uint8_t* in, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (size_t len = 0; len < MAX_VARINT_SIZE && in + len < end; len++) {
+        value |= (uint64_t)(in[len] & 0x7F) << (7 * len);
+        if ((in[len] & 0x80) == 0) {
+            return len + 1;
+        }
+    }
+    return 0;
+}
+
+// Data packets
+
+static inline size_t encodeDataPacketHeader(uint8_t* out, uint8_t format, uint16_t packetNumber,
+                                            uint16_t totalPackets, uint8_t pointsInPacket,
+                                            uint32_t firstSequence) {
+    out[0] = NEST_PROTOCOL_VERSION;
+    out[1] = format;
+    putLe16(&out[2], packetNumber);
+    putLe16(&out[4], totalPackets);
+    out[6] = pointsInPacket;
+    putLe32(&out[7], firstSequence);
+    return DATA_PACKET_HEADER_SIZE;
+}
+
+static inline size_t encodeDataPoint(uint8_t* out, const DataPoint& point) {
+    out[0] = point.val1;
+    putLe32(&out[1], point.val2);
+    putLe32(&out[5], point.val3);
+    return DATA_POINT_WIRE_SIZE;
+}
+
+static inline size_t encodeDeltaPoint(uint8_t* out, const DataPoint& point, uint32_t previousEnd) {
+    uint8_t state = point.val1 < DELTA_STATE_ESCAPE ? point.val1 : DELTA_STATE_ESCAPE;
+    uint64_t startField = ((uint64_t)zigzagEncode((int32_t)(point.val2 - previousEnd)) << 2) | state;
+    
+    size_t len = putVarint(out, startField);
+    if (state == DELTA_STATE_ESCAPE) {
+        out[len++] = point.val1;
+    }
+    len += putVarint(&out[len], zigzagEncode((int32_t)(point.val3 - point.val2)));
+    return len;
+}
+
+// Encodes as many of the count points as fit in capacity bytes (at most 255)
+// and returns the packet size. pointsEncoded tells the caller where the next
+// packet starts; packet boundaries never depend on totalPackets.
+// Points carry consecutive sequence numbers starting at firstSequence.
+static inline size_t encodeDataPacket(uint8_t* out, size_t capacity, uint8_t format,
+                                      uint16_t packetNumber, uint16_t totalPackets,
+                                      uint32_t firstSequence,
+                                      const DataPoint* points, int count, int& pointsEncoded) {
+    size_t pos = DATA_PACKET_HEADER_SIZE;
+    int encoded = 0;
+    
+    if (format == PACKET_FORMAT_DELTA && count > 0 && capacity >= pos + DELTA_BASE_SIZE) {
+        uint32_t previousEnd = points[0].val2;
+        putLe32(&out[pos], previousEnd);
+        pos += DELTA_BASE_SIZE;
+        
+        uint8_t scratch[MAX_DELTA_POINT_SIZE];
+        while (encoded < count && encoded < 255) {
+            size_t len = encodeDeltaPoint(scratch, points[encoded], previousEnd);
+            if (pos + len > capacity) {
+                break;
+            }
+            for (size_t i = 0; i < len; i++) {
+                out[pos + i] = scratch[i];
+            }
+            pos += len;
+            previousEnd = points[encoded].val3;
+            encoded++;
+        }
+    } else if (format == PACKET_FORMAT_RAW) {
+        while (encoded < count && encoded < 255 && pos + DATA_POINT_WIRE_SIZE <= capacity) {
+            pos += encodeDataPoint(&out[pos], points[encoded]);
+            encoded++;
+        }
+    }
+    
+    encodeDataPacketHeader(out, format, packetNumber, totalPackets, encoded, firstSequence);
+    pointsEncoded = encoded;
+    return pos;
+}
+
+// Returns false for short buffers, unknown protocol versions and formats
+static inline bool decodeDataPacketHeader(const uint8_t* in, size_t len, DataPacketHeader& header) {
+    if (len < DATA_PACKET_HEADER_SIZE) {
+        return false;
+    }
+    header.version = in[0];
+    header.format = in[1];
+    header.packetNumber = getLe16(&in[2]);
+    header.totalPackets = getLe16(&in[4]);
+    header.pointsInPacket = in[6];
+    header.firstSequence = getLe32(&in[7]);
+    return header.version == NEST_PROTOCOL_VERSION &&
+           (header.format == PACKET_FORMAT_RAW || header.format == PACKET_FORMAT_DELTA);
+}
+
+// Walks the points of one received packet without copying it
+struct DataPacketReader {
+    DataPacketHeader header;
+    const uint8_t* pos;
+    const uint8_t* end;
+    uint32_t previousEnd;
+    int remaining;
+};
+
+static inline bool openDataPacket(DataPacketReader& reader, const uint8_t* data, size_t len) {
+    if (!decodeDataPacketHeader(data, len, reader.header)) {
+        return false;
+    }
+    reader.pos = data + DATA_PACKET_HEADER_SIZE;
+    reader.end = data + len;
+    reader.previousEnd = 0;
+    reader.remaining = reader.header.pointsInPacket;
+    
+    if (reader.header.format == PACKET_FORMAT_RAW) {
+        return len >= DATA_PACKET_HEADER_SIZE + reader.remaining * DATA_POINT_WIRE_SIZE;
+    }
+    if (reader.remaining == 0) {
+        return true;
+    }
+    if (reader.end - reader.pos < DELTA_BASE_SIZE) {
+        return false;
+    }
+    reader.previousEnd = getLe32(reader.pos);
+    reader.pos += DELTA_BASE_SIZE;
+    return true;
+}
+
+// Returns false once all points are read, or if the packet is malformed
+// (check reader.remaining to tell the two apart)
+static inline bool readDataPoint(DataPacketReader& reader, DataPoint& point) {
+    if (reader.remaining <= 0) {
+        return false;
+    }
+    
+    if (reader.header.format == PACKET_FORMAT_RAW) {
+        point.val1 = reader.pos[0];
+        point.val2 = getLe32(&reader.pos[1]);
+        point.val3 = getLe32(&reader.pos[5]);
+        reader.pos += DATA_POINT_WIRE_SIZE;
+        reader.remaining--;
+        return true;
+    }
+    
+    uint64_t startField;
+    uint64_t durationField;
+    size_t len = getVarint(reader.pos, reader.end, startField);
+    if (len == 0) {
+        return false;
+    }
+    reader.pos += len;
+    
+    uint8_t state = startField & 0x03;
+    if (state == DELTA_STATE_ESCAPE) {
+        if (reader.pos >= reader.end) {
+            return false;
+        }
+        state = *reader.pos++;
+    }
+    
+    len = getVarint(reader.pos, reader.end, durationField);
+    if (len == 0) {
+        return false;
+    }
+    reader.pos += len;
+    
+    point.val1 = state;
+    point.val2 = reader.previousEnd + zigzagDecode((uint32_t)(startField >> 2));
+    point.val3 = point.val2 + zigzagDecode((uint32_t)durationField);
+    reader.previousEnd = point.val3;
+    reader.remaining--;
+    return true;
+}
+
+// Scan response records
+
+// Appends [base (uint32 LE)][delta points] after the status, all count points
+// or nothing; returns the bytes added
+static inline size_t encodeAdvRecords(uint8_t* out, size_t capacity,
+                                      const DataPoint* points, int count) {
+    if (count <= 0 || count > MAX_ADV_INLINE_RECORDS || capacity < DELTA_BASE_SIZE) {
+        return 0;
+    }
+    uint32_t previousEnd = points[0].val2;
+    putLe32(out, previousEnd);
+    size_t pos = DELTA_BASE_SIZE;
+    
+    uint8_t scratch[MAX_DELTA_POINT_SIZE];
+    for (int i = 0; i < count; i++) {
+        size_t len = encodeDeltaPoint(scratch, points[i], previousEnd);
+        if (pos + len > capacity) {
+            return 0;
+        }
+        for (size_t j = 0; j < len; j++) {
+            out[pos + j] = scratch[j];
+        }
+        pos += len;
+        previousEnd = points[i].val3;
+    }
+    return pos;
+}
+
+// Sets the reader up to walk the inline records of a decoded status; they are
+// the pending records, so they end at lastSequence
+static inline bool openAdvRecords(DataPacketReader& reader, const uint8_t* data, size_t len,
+                                  const AdvStatus& status) {
+    if (!status.recordsInline || len < ADV_STATUS_SIZE + DELTA_BASE_SIZE) {
+        return false;
+    }
+    reader.header.version = NEST_PROTOCOL_VERSION;
+    reader.header.format = PACKET_FORMAT_DELTA;
+    reader.header.packetNumber = 1;
+    reader.header.totalPackets = 1;
+    reader.header.pointsInPacket = status.pendingRecords;
+    reader.header.firstSequence = status.lastSequence - status.pendingRecords + 1;
+    reader.pos = data + ADV_STATUS_SIZE + DELTA_BASE_SIZE;
+    reader.end = data + len;
+    reader.previousEnd = getLe32(data + ADV_STATUS_SIZE);
+    reader.remaining = status.pendingRecords;
+    return true;
+}
+
+// Gateway frames: what the nRF52 central streams to a PC over USB serial
+
+// [version][feather address (6, LSB first)][first sequence (uint32 LE)][count]
+// [count raw points][CRC-16 (LE) over everything before], COBS-encoded and
+// sent between 0x00 delimiters. Text on the same port never contains 0x00,
+// so a reader skips it as frames that fail the CRC.
+#define GATEWAY_FRAME_VERSION          1
+#define GATEWAY_ADDRESS_SIZE           6
+#define GATEWAY_FRAME_HEADER_SIZE      12
+#define GATEWAY_CRC_SIZE               2
+#define GATEWAY_MAX_POINTS             28
+#define GATEWAY_MAX_PAYLOAD            (GATEWAY_FRAME_HEADER_SIZE + GATEWAY_MAX_POINTS * DATA_POINT_WIRE_SIZE + GATEWAY_CRC_SIZE)
+// COBS adds one byte per 254 plus one
+#define GATEWAY_MAX_ENCODED            (GATEWAY_MAX_PAYLOAD + GATEWAY_MAX_PAYLOAD / 254 + 1)
+#define GATEWAY_DELIMITER              0x00
+
+struct GatewayFrame {
+    uint8_t address[GATEWAY_ADDRESS_SIZE];
+    uint32_t firstSequence;   // Points are numbered firstSequence + index
+    uint8_t pointCount;
+    const uint8_t* points;    // pointCount DataPointWire, inside the decoded buffer
+};
+
+// CRC-16/CCITT-FALSE, bitwise: frames are short and the table would cost 512 bytes
+static inline uint16_t crc16(const uint8_t* data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Consistent overhead byte stuffing: out holds no 0x00; returns the encoded length
+static inline size_t cobsEncode(uint8_t* out, const uint8_t* in, size_t len) {
+    size_t codePos = 0;
+    size_t pos = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] != 0) {
+            out[pos++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xFF) {
+            out[codePos] = code;
+            codePos = pos++;
+            code = 1;
+        }
+    }
+    out[codePos] = code;
+    return pos;
+}
+
+// Inverse of cobsEncode, in may alias out; returns 0 for malformed input
+static inline size_t cobsDecode(uint8_t* out, const uint8_t* in, size_t len) {
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > len) {
+            return 0;
+        }
+        for (uint8_t j = 1; j < code; j++) {
+            out[pos++] = in[i++];
+        }
+        if (code != 0xFF && i < len) {
+            out[pos++] = 0;
+        }
+    }
+    return pos;
+}
+
+// Builds the unencoded frame for up to GATEWAY_MAX_POINTS points; returns its length
+static inline size_t encodeGatewayFrame(uint8_t* out, const uint8_t* address, uint32_t firstSequence,
+                                        const DataPoint* points, int count) {
+    if (count < 0 || count > GATEWAY_MAX_POINTS) {
+        return 0;
+    }
+    out[0] = GATEWAY_FRAME_VERSION;
+    for (int i = 0; i < GATEWAY_ADDRESS_SIZE; i++) {
+        out[1 + i] = address[i];
+    }
+    putLe32(&out[7], firstSequence);
+    out[11] = count;
+    size_t pos = GATEWAY_FRAME_HEADER_SIZE;
+    for (int i = 0; i < count; i++) {
+        pos += encodeDataPoint(&out[pos], points[i]);
+    }
+    putLe16(&out[pos], crc16(out, pos));
+    return pos + GATEWAY_CRC_SIZE;
+}
+
+// Checks version, length and CRC of an unencoded frame
+static inline bool decodeGatewayFrame(const uint8_t* in, size_t len, GatewayFrame& frame) {
+    if (len < GATEWAY_FRAME_HEADER_SIZE + GATEWAY_CRC_SIZE || in[0] != GATEWAY_FRAME_VERSION) {
+        return false;
+    }
+    frame.pointCount = in[11];
+    if (len != GATEWAY_FRAME_HEADER_SIZE + frame.pointCount * DATA_POINT_WIRE_SIZE + GATEWAY_CRC_SIZE ||
+        getLe16(&in[len - GATEWAY_CRC_SIZE]) != crc16(in, len - GATEWAY_CRC_SIZE)) {
+        return false;
+    }
+    for (int i = 0; i < GATEWAY_ADDRESS_SIZE; i++) {
+        frame.address[i] = in[1 + i];
+    }
+    frame.firstSequence = getLe32(&in[7]);
+    frame.points = in + GATEWAY_FRAME_HEADER_SIZE;
+    return true;
+}
+
+#endif // NEST_PROTOCOL_H
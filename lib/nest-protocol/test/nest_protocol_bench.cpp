@@ -0,0 +1,107 @@
+// Time to encode and decode a batch of data packets, raw and delta, on the
+// host. The points are back-to-back state intervals, the way a feather logs
+// them.
+//
+// Build and run from this directory:
+//   make bench
+
+#include "nest_protocol.h"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#define BENCH_POINTS    100000
+#define BENCH_ROUNDS    20
+
+struct BenchResult {
+    double encodeNs;    // Per point
+    double decodeNs;    // Per point
+    double bytesPerPoint;
+};
+
+static std::vector<DataPoint> makePoints(size_t count) {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> state(0, 5);
+    std::uniform_int_distribution<int> duration(1, 3600);
+
+    std::vector<DataPoint> points(count);
+    uint32_t time = 1700000000;
+    for (auto& point : points) {
+        point.val1 = (uint8_t)state(rng);
+        point.val2 = time;
+        time += duration(rng);
+        point.val3 = time;
+    }
+    return points;
+}
+
+static BenchResult runBench(const std::vector<DataPoint>& points, uint8_t format) {
+    // Worst case: one point per packet
+    std::vector<uint8_t> packets(points.size() * (DATA_PACKET_HEADER_SIZE + DELTA_BASE_SIZE + MAX_DELTA_POINT_SIZE) +
+                                 MAX_NOTIFY_PAYLOAD);
+    std::vector<size_t> sizes;
+    BenchResult result = {};
+    volatile uint32_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t bytes = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        sizes.clear();
+        bytes = 0;
+        int done = 0;
+        uint16_t packetNumber = 1;
+        while (done < (int)points.size()) {
+            int encoded = 0;
+            size_t len = encodeDataPacket(&packets[bytes], MAX_NOTIFY_PAYLOAD, format, packetNumber++, 0,
+                                          done, &points[done], (int)points.size() - done, encoded);
+            sizes.push_back(len);
+            bytes += len;
+            done += encoded;
+        }
+    }
+    auto encoded = std::chrono::steady_clock::now();
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        size_t offset = 0;
+        for (size_t len : sizes) {
+            DataPacketReader reader {};
+            DataPoint point;
+            if (openDataPacket(reader, &packets[offset], len)) {
+                while (readDataPoint(reader, point)) {
+                    sink = sink + point.val3;
+                }
+            }
+            offset += len;
+        }
+    }
+    auto decoded = std::chrono::steady_clock::now();
+    (void)sink;
+
+    double total = (double)BENCH_ROUNDS * points.size();
+    result.encodeNs = std::chrono::duration<double, std::nano>(encoded - start).count() / total;
+    result.decodeNs = std::chrono::duration<double, std::nano>(decoded - encoded).count() / total;
+    result.bytesPerPoint = (double)bytes / points.size();
+    return result;
+}
+
+int main() {
+    auto points = makePoints(BENCH_POINTS);
+
+    const struct {
+        const char* name;
+        uint8_t format;
+    } formats[] = {
+        {"raw", PACKET_FORMAT_RAW},
+        {"delta", PACKET_FORMAT_DELTA},
+    };
+    for (auto& f : formats) {
+        runBench(points, f.format);     // Warm up
+        BenchResult result = runBench(points, f.format);
+        printf("%-5s  encode %5.1f ns/point  decode %5.1f ns/point  %4.2f bytes/point on air\n",
+               f.name, result.encodeNs, result.decodeNs, result.bytesPerPoint);
+    }
+    return 0;
+}
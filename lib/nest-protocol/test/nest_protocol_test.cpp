@@ -0,0 +1,390 @@
+// Host checks of nest_protocol.h: byte order of the little-endian helpers, the
+// packet header and scan response layouts, version rejection, raw packets, and
+// delta packets: round trips, the capacity and 255-point cut-offs, truncation
+// and a fuzz.
+//
+// Build and run from this directory:
+//   make test        (make sanitize: the same under ASan/UBSan)
+
+#include "nest_protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            if (failures++ < 20) { \
+                printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            } \
+        } \
+    } while (0)
+
+static void testLittleEndian() {
+    uint8_t buffer[8];
+
+    memset(buffer, 0xAA, sizeof(buffer));
+    putLe16(&buffer[1], 0x1234);
+    CHECK(buffer[0] == 0xAA && buffer[1] == 0x34 && buffer[2] == 0x12 && buffer[3] == 0xAA);
+    CHECK(getLe16(&buffer[1]) == 0x1234);
+
+    memset(buffer, 0xAA, sizeof(buffer));
+    putLe32(&buffer[3], 0x12345678);
+    CHECK(buffer[2] == 0xAA && buffer[3] == 0x78 && buffer[4] == 0x56 &&
+          buffer[5] == 0x34 && buffer[6] == 0x12 && buffer[7] == 0xAA);
+    CHECK(getLe32(&buffer[3]) == 0x12345678);
+
+    // High bits must not sign-extend
+    const uint8_t high[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+    CHECK(getLe16(high) == 0xFFFF);
+    CHECK(getLe32(high) == 0xFFFFFFFF);
+
+    const uint32_t values[] = {0, 1, 0x80, 0xFF, 0x100, 0x8000, 0xFFFF, 0x10000, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF};
+    for (uint32_t value : values) {
+        putLe16(buffer, (uint16_t)value);
+        CHECK(getLe16(buffer) == (uint16_t)value);
+        putLe32(buffer, value);
+        CHECK(getLe32(buffer) == value);
+    }
+}
+
+static void testDataPacketHeader() {
+    uint8_t packet[DATA_PACKET_HEADER_SIZE + 1];
+    memset(packet, 0xAA, sizeof(packet));
+
+    CHECK(encodeDataPacketHeader(packet, PACKET_FORMAT_DELTA, 0x0102, 0x0304, 0x05, 0x06070809) ==
+          DATA_PACKET_HEADER_SIZE);
+    const uint8_t expected[DATA_PACKET_HEADER_SIZE] = {
+        NEST_PROTOCOL_VERSION, PACKET_FORMAT_DELTA, 0x02, 0x01, 0x04, 0x03, 0x05, 0x09, 0x08, 0x07, 0x06,
+    };
+    CHECK(memcmp(packet, expected, sizeof(expected)) == 0);
+    CHECK(packet[DATA_PACKET_HEADER_SIZE] == 0xAA);
+
+    DataPacketHeader header;
+    CHECK(decodeDataPacketHeader(packet, DATA_PACKET_HEADER_SIZE, header));
+    CHECK(header.version == NEST_PROTOCOL_VERSION);
+    CHECK(header.format == PACKET_FORMAT_DELTA);
+    CHECK(header.packetNumber == 0x0102);
+    CHECK(header.totalPackets == 0x0304);
+    CHECK(header.pointsInPacket == 0x05);
+    CHECK(header.firstSequence == 0x06070809);
+
+    encodeDataPacketHeader(packet, PACKET_FORMAT_RAW, 0xFFFF, 0xFFFF, 0xFF, 0xFFFFFFFF);
+    CHECK(decodeDataPacketHeader(packet, DATA_PACKET_HEADER_SIZE, header));
+    CHECK(header.format == PACKET_FORMAT_RAW);
+    CHECK(header.packetNumber == 0xFFFF && header.totalPackets == 0xFFFF);
+    CHECK(header.pointsInPacket == 0xFF && header.firstSequence == 0xFFFFFFFF);
+
+    // Short buffers
+    for (size_t len = 0; len < DATA_PACKET_HEADER_SIZE; len++) {
+        CHECK(!decodeDataPacketHeader(packet, len, header));
+    }
+
+    // Other protocol versions and unknown formats
+    for (int version = 0; version < 256; version++) {
+        packet[0] = (uint8_t)version;
+        packet[1] = PACKET_FORMAT_DELTA;
+        CHECK(decodeDataPacketHeader(packet, DATA_PACKET_HEADER_SIZE, header) == (version == NEST_PROTOCOL_VERSION));
+    }
+    packet[0] = NEST_PROTOCOL_VERSION;
+    for (int format = 0; format < 256; format++) {
+        packet[1] = (uint8_t)format;
+        CHECK(decodeDataPacketHeader(packet, DATA_PACKET_HEADER_SIZE, header) ==
+              (format == PACKET_FORMAT_RAW || format == PACKET_FORMAT_DELTA));
+    }
+
+    DataPacketReader reader {};
+    packet[0] = NEST_PROTOCOL_VERSION - 1;
+    packet[1] = PACKET_FORMAT_RAW;
+    CHECK(!openDataPacket(reader, packet, DATA_PACKET_HEADER_SIZE));
+}
+
+static void testAdvStatus() {
+    uint8_t data[ADV_STATUS_SIZE + 1];
+    AdvStatus status = {ADV_FLAG_NEEDS_TIME_SYNC, 0x0102, 0x03040506, false};
+
+    CHECK(encodeAdvStatus(data, status) == ADV_STATUS_SIZE);
+    const uint8_t expected[ADV_STATUS_SIZE] = {
+        0xFF, 0xFF, NEST_PROTOCOL_VERSION, ADV_FLAG_NEEDS_TIME_SYNC, 0x02, 0x01, 0x06, 0x05, 0x04, 0x03,
+    };
+    CHECK(memcmp(data, expected, sizeof(expected)) == 0);
+
+    AdvStatus decoded;
+    CHECK(decodeAdvStatus(data, ADV_STATUS_SIZE, decoded));
+    CHECK(decoded.flags == status.flags);
+    CHECK(decoded.pendingRecords == status.pendingRecords);
+    CHECK(decoded.lastSequence == status.lastSequence);
+    CHECK(!decoded.recordsInline);
+
+    CHECK(!decodeAdvStatus(data, ADV_STATUS_SIZE - 1, decoded));
+    data[2] = NEST_PROTOCOL_VERSION + 1;
+    CHECK(!decodeAdvStatus(data, ADV_STATUS_SIZE, decoded));
+    data[2] = NEST_PROTOCOL_VERSION;
+    data[0] = 0x59;
+    CHECK(!decodeAdvStatus(data, ADV_STATUS_SIZE, decoded));
+}
+
+static void testRawPacket() {
+    const DataPoint points[3] = {
+        {0, 1700000000, 1700000060},
+        {255, 0xFFFFFFFF, 0},
+        {7, 0x01020304, 0x05060708},
+    };
+    uint8_t packet[DATA_PACKET_HEADER_SIZE + 3 * DATA_POINT_WIRE_SIZE];
+    int encoded = 0;
+
+    size_t len = encodeDataPacket(packet, sizeof(packet), PACKET_FORMAT_RAW, 2, 5, 100, points, 3, encoded);
+    CHECK(encoded == 3);
+    CHECK(len == sizeof(packet));
+    const uint8_t third[DATA_POINT_WIRE_SIZE] = {7, 0x04, 0x03, 0x02, 0x01, 0x08, 0x07, 0x06, 0x05};
+    CHECK(memcmp(&packet[DATA_PACKET_HEADER_SIZE + 2 * DATA_POINT_WIRE_SIZE], third, sizeof(third)) == 0);
+
+    DataPacketReader reader {};
+    CHECK(openDataPacket(reader, packet, len));
+    CHECK(reader.header.packetNumber == 2 && reader.header.totalPackets == 5);
+    CHECK(reader.header.pointsInPacket == 3 && reader.header.firstSequence == 100);
+    DataPoint point;
+    for (int i = 0; i < 3; i++) {
+        CHECK(readDataPoint(reader, point));
+        CHECK(point.val1 == points[i].val1 && point.val2 == points[i].val2 && point.val3 == points[i].val3);
+    }
+    CHECK(!readDataPoint(reader, point));
+    CHECK(reader.remaining == 0);
+
+    // A raw packet shorter than its point count is refused up front
+    CHECK(!openDataPacket(reader, packet, len - 1));
+
+    // Only whole points fit
+    len = encodeDataPacket(packet, sizeof(packet) - 1, PACKET_FORMAT_RAW, 1, 1, 0, points, 3, encoded);
+    CHECK(encoded == 2);
+    CHECK(len == DATA_PACKET_HEADER_SIZE + 2 * DATA_POINT_WIRE_SIZE);
+    CHECK(packet[6] == 2);
+}
+
+static bool samePoints(const DataPoint* a, const DataPoint* b, int count) {
+    for (int i = 0; i < count; i++) {
+        if (a[i].val1 != b[i].val1 || a[i].val2 != b[i].val2 || a[i].val3 != b[i].val3) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads every point of a packet; returns false unless the reader ran out of
+// points cleanly. reader.remaining is left for the caller to inspect.
+static bool readAll(DataPacketReader& reader, const uint8_t* packet, size_t len, DataPoint* out, int& count) {
+    count = 0;
+    if (!openDataPacket(reader, packet, len)) {
+        return false;
+    }
+    while (readDataPoint(reader, out[count])) {
+        count++;
+    }
+    return reader.remaining == 0;
+}
+
+// Encodes points into a packet of the given capacity and checks that the
+// points it took decode unchanged; returns how many it took
+static int roundTrip(const DataPoint* points, int count, size_t capacity) {
+    uint8_t packet[1024];
+    DataPoint decoded[256];
+    int encoded = -1;
+
+    size_t len = encodeDataPacket(packet, capacity, PACKET_FORMAT_DELTA, 1, 1, 42, points, count, encoded);
+    CHECK(len <= capacity || (encoded == 0 && len == DATA_PACKET_HEADER_SIZE));
+    CHECK(encoded >= 0 && encoded <= count && encoded <= 255);
+    CHECK(packet[6] == encoded);
+
+    DataPacketReader reader {};
+    int read = 0;
+    CHECK(readAll(reader, packet, len, decoded, read));
+    CHECK(read == encoded);
+    // A packet with no points may still carry the base; nothing reads it
+    CHECK(reader.pos == packet + len || encoded == 0);
+    CHECK(samePoints(points, decoded, encoded));
+
+    // The cut-off is the first point that no longer fits
+    if (encoded < count && encoded < 255 && len > DATA_PACKET_HEADER_SIZE) {
+        uint8_t scratch[MAX_DELTA_POINT_SIZE];
+        uint32_t previousEnd = encoded ? points[encoded - 1].val3 : points[0].val2;
+        CHECK(len + encodeDeltaPoint(scratch, points[encoded], previousEnd) > capacity);
+    }
+    return encoded;
+}
+
+static void testDeltaRoundTrip() {
+    // Every state, including the escaped ones from DELTA_STATE_ESCAPE up
+    DataPoint points[256];
+    for (int i = 0; i < 256; i++) {
+        points[i] = {(uint8_t)i, 1700000000u + 10 * i, 1700000000u + 10 * i + 10};
+    }
+    CHECK(roundTrip(points, 256, sizeof(points) * 4) == 255);
+
+    uint8_t bytes[MAX_DELTA_POINT_SIZE];
+    DataPoint escaped = {DELTA_STATE_ESCAPE, 100, 101};
+    CHECK(encodeDeltaPoint(bytes, escaped, 100) == 3);
+    CHECK(bytes[0] == DELTA_STATE_ESCAPE && bytes[1] == DELTA_STATE_ESCAPE && bytes[2] == 2);
+    DataPoint plain = {DELTA_STATE_ESCAPE - 1, 100, 101};
+    CHECK(encodeDeltaPoint(bytes, plain, 100) == 2);
+
+    // Gaps, overlaps, negative durations and wrap-around of the 32-bit times
+    const DataPoint edges[] = {
+        {1, 1000, 2000},
+        {2, 500, 400},                  // Starts before the previous end, ends before it starts
+        {255, 0xFFFFFFF0, 0x00000010},  // Wraps inside the interval
+        {0, 0x00000005, 0xFFFFFFFB},    // Wraps back
+        {3, 0x7FFFFFFF, 0x80000000},
+        {4, 0xFFFFFFFF, 0x7FFFFFFF},    // Extreme positive and negative deltas
+        {5, 0x7FFFFFFF, 0xFFFFFFFF},
+        {6, 0x80000000, 0x00000000},
+        {0, 0, 0},
+    };
+    int count = sizeof(edges) / sizeof(edges[0]);
+    CHECK(roundTrip(edges, count, 1024) == count);
+    CHECK(encodeDeltaPoint(bytes, edges[5], edges[4].val3) <= MAX_DELTA_POINT_SIZE);
+
+    // A base that is not the first start is only possible across packets
+    CHECK(roundTrip(&edges[2], count - 2, 1024) == count - 2);
+}
+
+static void testDeltaCapacity() {
+    DataPoint points[300];
+    for (int i = 0; i < 300; i++) {
+        points[i] = {(uint8_t)(i % 7), 1700000000u + 100 * i, 1700000000u + 100 * i + 100};
+    }
+
+    // Smaller than header and base: no points, just the header
+    uint8_t packet[1024];
+    int encoded = -1;
+    for (size_t capacity = DATA_PACKET_HEADER_SIZE; capacity < DATA_PACKET_HEADER_SIZE + DELTA_BASE_SIZE; capacity++) {
+        CHECK(encodeDataPacket(packet, capacity, PACKET_FORMAT_DELTA, 1, 1, 0, points, 300, encoded) ==
+              DATA_PACKET_HEADER_SIZE);
+        CHECK(encoded == 0);
+    }
+
+    // Every capacity up to a full notification stops at the last point that fits
+    int previous = 0;
+    for (size_t capacity = DATA_PACKET_HEADER_SIZE + DELTA_BASE_SIZE; capacity <= MAX_NOTIFY_PAYLOAD; capacity++) {
+        int taken = roundTrip(points, 300, capacity);
+        CHECK(taken >= previous);
+        previous = taken;
+    }
+    CHECK(previous > 0 && previous < 255);
+
+    // The 255-point cap, and the batch continues where the packet stopped
+    CHECK(roundTrip(points, 300, sizeof(packet)) == 255);
+    CHECK(roundTrip(&points[255], 45, sizeof(packet)) == 45);
+    CHECK(roundTrip(points, 255, sizeof(packet)) == 255);
+    CHECK(roundTrip(points, 0, sizeof(packet)) == 0);
+}
+
+static void testDeltaTruncated() {
+    DataPoint points[40];
+    for (int i = 0; i < 40; i++) {
+        points[i] = {(uint8_t)(i * 37), 0xFFFFFF00u + 1000 * i, 0xFFFFFF00u + 1000 * i + 999};
+    }
+    uint8_t packet[MAX_NOTIFY_PAYLOAD];
+    int encoded = 0;
+    size_t full = encodeDataPacket(packet, sizeof(packet), PACKET_FORMAT_DELTA, 1, 1, 0, points, 40, encoded);
+    CHECK(encoded == 40);
+
+    // Every shorter length either fails to open or stops with points left,
+    // so the receiver can tell a cut packet from a complete one
+    DataPoint decoded[256];
+    for (size_t len = 0; len < full; len++) {
+        uint8_t cut[MAX_NOTIFY_PAYLOAD];
+        memcpy(cut, packet, len);
+        DataPacketReader reader {};
+        int read = 0;
+        CHECK(!readAll(reader, cut, len, decoded, read));
+        if (len >= DATA_PACKET_HEADER_SIZE + DELTA_BASE_SIZE) {
+            CHECK(reader.remaining != 0);
+            CHECK(reader.pos <= cut + len);
+            CHECK(samePoints(points, decoded, read));
+        }
+    }
+}
+
+// Random batches through every capacity, then random damage to the packets:
+// the decoder must stay inside the buffer and never report a damaged packet
+// as complete with the wrong number of points
+static void fuzzDelta(long iterations) {
+    uint32_t seed = 12345;
+    auto next = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+
+    DataPoint points[300];
+    DataPoint decoded[256];
+    long packets = 0;
+    for (long i = 0; i < iterations; i++) {
+        int count = next() % 300;
+        uint32_t time = next();
+        for (int j = 0; j < count; j++) {
+            switch (i % 3) {
+                case 0:     // Back-to-back, small states
+                    points[j].val1 = next() % 4;
+                    points[j].val2 = time;
+                    time += next() % 5000;
+                    points[j].val3 = time;
+                    break;
+                case 1:     // Anything
+                    points[j].val1 = next();
+                    points[j].val2 = next();
+                    points[j].val3 = next();
+                    break;
+                default:    // Small gaps both ways
+                    points[j].val1 = next();
+                    points[j].val2 = time + (int32_t)(next() % 200) - 100;
+                    points[j].val3 = points[j].val2 + (int32_t)(next() % 2000) - 1000;
+                    time = points[j].val3;
+                    break;
+            }
+        }
+        size_t capacity = DATA_PACKET_HEADER_SIZE + next() % 1000;
+        int encoded = roundTrip(points, count, capacity);
+
+        uint8_t packet[1024];
+        size_t len = encodeDataPacket(packet, capacity, PACKET_FORMAT_DELTA, 1, 1, 0, points, count, encoded);
+        int flips = 1 + next() % 4;
+        for (int j = 0; j < flips; j++) {
+            packet[next() % len] ^= (uint8_t)(1 << (next() % 8));
+        }
+        size_t damagedLen = (next() % 2) ? len : next() % (len + 1);
+
+        // Exactly sized, so ASan catches any read past the end
+        uint8_t* damaged = new uint8_t[damagedLen];
+        memcpy(damaged, packet, damagedLen);
+        DataPacketReader reader {};
+        int read = 0;
+        if (readAll(reader, damaged, damagedLen, decoded, read)) {
+            CHECK(read == damaged[6]);
+            CHECK(reader.pos <= damaged + damagedLen);
+        }
+        delete[] damaged;
+        packets++;
+    }
+    printf("delta fuzz: %ld packets\n", packets);
+}
+
+int main(int argc, char** argv) {
+    long iterations = (argc > 1) ? atol(argv[1]) : 200000;
+
+    testLittleEndian();
+    testDataPacketHeader();
+    testAdvStatus();
+    testRawPacket();
+    testDeltaRoundTrip();
+    testDeltaCapacity();
+    testDeltaTruncated();
+    fuzzDelta(iterations);
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -30,14 +30,16 @@ constexpr system_tick_t LOCATION_INACTIVE_PERIOD_SUCCESS_MS {120 * 1000};
 constexpr system_tick_t LOCATION_PERIOD_ACQUIRE_MS {1 * 1000};
 constexpr system_tick_t ANTENNA_POWER_SETTLING_MS {100};
 constexpr int LOCATION_REQUIRED_SETTLING_COUNT {2};  // Number of consecutive fixes
+constexpr int LOCATION_COMMAND_QUEUE_DEPTH {2};      // Room for a tracking command next to a wake-up
+constexpr int LOCATION_TRACKING_FRESH_PERIODS {2};   // Tracked fixes older than this many periods are not served
 
 Logger locationLog("loc");
 
 SomLocation *SomLocation::_instance = nullptr;
 
 SomLocation::SomLocation() {
-    os_queue_create(&_commandQueue, sizeof(LocationCommandContext), 1, nullptr);
-    os_queue_create(&_responseQueue, sizeof(LocationResults), 1, nullptr);
+    os_queue_create(&_commandQueue, sizeof(LocationCommandContext), LOCATION_COMMAND_QUEUE_DEPTH, nullptr);
+    os_mutex_create(&_fixLock);
     _thread = new Thread("gnss_cellular", [this]() {SomLocation::threadLoop();}, OS_THREAD_PRIORITY_DEFAULT);
 }
 
@@ -136,7 +138,7 @@ int SomLocation::begin(LocationConfiguration& configuration) {
     return 0;
 }
 
-LocationResults SomLocation::getLocation(LocationPoint& point, bool publish) {
+LocationResults SomLocation::checkModem() {
     if (!isModemOn()) {
         locationLog.trace("Modem is not on");
         return LocationResults::Unavailable;
@@ -149,321 +151,457 @@ LocationResults SomLocation::getLocation(LocationPoint& point, bool publish) {
         }
     }
 
-    // Check if already running
-    if (_acquiring.load()) {
-        locationLog.trace("Aquisition is already underway");
-        return LocationResults::Pending;
-    }
-    locationLog.trace("Starting synchronous aquisition");
-    LocationCommandContext event {};
-    event.command = LocationCommand::Acquire;
-    event.point = &point;
-    event.sendResponse = true;
-    os_queue_put(_commandQueue, &event, 0, nullptr);
-    auto result = waitOnResponseEvent((system_tick_t)_conf.maximumFixTime() * 1000 + LOCATION_PERIOD_ACQUIRE_MS);
-    if (publish && (LocationResults::Fixed == result) && isConnected()) {
-        locationLog.info("Publishing loc event");
-        buildPublish(_publishBuffer, sizeof(_publishBuffer), point, _reqid);
-        auto published = Particle.publish("loc", _publishBuffer);
-        if (published) {
-            _reqid++;
-        }
+    return LocationResults::Idle;
+}
+
+LocationResults SomLocation::getLocation(LocationPoint& point, bool publish, system_tick_t maxAge) {
+    // Every attached request is answered: single acquisitions end within the maximum
+    // fix time, tracked requests expire after it and both end when the modem goes off
+    os_semaphore_t done;
+    os_semaphore_create(&done, 1, 0);
+    LocationResults response {LocationResults::Idle};
+    auto result = getLocation(point, [&](LocationResults results) {
+        response = results;
+        os_semaphore_give(done, false);
+    }, publish, maxAge);
+    if (LocationResults::Acquiring == result) {
+        locationLog.trace("Waiting for synchronous completion");
+        os_semaphore_take(done, CONCURRENT_WAIT_FOREVER, false);
+        result = response;
     }
+    os_semaphore_destroy(done);
     return result;
 }
 
-LocationResults SomLocation::getLocation(LocationPoint& point, LocationDone callback, bool publish) {
-    if (!isModemOn()) {
-        locationLog.trace("Modem is not on");
-        return LocationResults::Unavailable;
+LocationResults SomLocation::getLocation(LocationPoint& point, LocationDone callback, bool publish, system_tick_t maxAge) {
+    // A recent enough fix answers right away, without powering GNSS
+    if (_tracking.load()) {
+        maxAge = std::max(maxAge, (system_tick_t)(LOCATION_TRACKING_FRESH_PERIODS * _conf.trackingPeriod()));
     }
-    if (modemNotDetected()) {
-        auto detected = detectModemType();
-        if (!detected) {
-            locationLog.trace("Modem is not supported");
-            return LocationResults::Unsupported;
+    if (maxAge && copyRecentFix(point, maxAge)) {
+        locationLog.trace("Answered from a recent fix");
+        recordLatency(_tracking.load() ? LocationMode::Tracking : LocationMode::Single, 0.0);
+        if (callback) {
+            callback(LocationResults::Fixed);
         }
+        return LocationResults::Fixed;
+    }
+
+    auto available = checkModem();
+    if (LocationResults::Idle != available) {
+        return available;
     }
 
-    // Check if already running
-    if (_acquiring.load()) {
-        locationLog.trace("Aquisition is already underway");
+    // Attach to the acquisition in flight, or start one
+    LocationCommandContext request {};
+    request.command = LocationCommand::Acquire;
+    request.point = &point;
+    request.doneCallback = callback;
+    request.publish = publish;
+    request.requested = System.millis();
+
+    os_mutex_lock(_fixLock);
+    if (LOCATION_MAX_REQUESTS == _requestCount) {
+        os_mutex_unlock(_fixLock);
+        locationLog.trace("Request list is full");
         return LocationResults::Pending;
     }
-    locationLog.trace("Starting asynchronous aquisition");
-    LocationCommandContext event {};
-    event.command = LocationCommand::Acquire;
-    event.point = &point;
-    event.doneCallback = callback;
-    event.publish = publish;
-    os_queue_put(_commandQueue, &event, 0, nullptr);
+    _requests[_requestCount++] = request;
+    auto start = !_acquiring.exchange(true);
+    os_mutex_unlock(_fixLock);
+
+    if (start) {
+        locationLog.trace("Starting aquisition");
+        // Only a wake-up, the thread also finds the request on its next pass
+        LocationCommandContext event {};
+        event.command = LocationCommand::Acquire;
+        os_queue_put(_commandQueue, &event, 0, nullptr);
+    }
+    else {
+        locationLog.trace("Attached to the aquisition underway");
+    }
     return LocationResults::Acquiring;
 }
 
-LocationCommandContext SomLocation::waitOnCommandEvent(system_tick_t timeout) {
-    LocationCommandContext event = {};
-    auto ret = os_queue_take(_commandQueue, &event, timeout, nullptr);
-    if (ret) {
-        event.command = LocationCommand::None;
-        event.point = nullptr;
+LocationResults SomLocation::startTracking() {
+    auto available = checkModem();
+    if (LocationResults::Idle != available) {
+        return available;
     }
 
-    return event;
+    LocationCommandContext event {};
+    event.command = LocationCommand::StartTracking;
+    if (os_queue_put(_commandQueue, &event, 0, nullptr)) {
+        locationLog.trace("Command queue is full");
+        return LocationResults::Pending;
+    }
+    return LocationResults::Acquiring;
 }
 
-LocationResults SomLocation::waitOnResponseEvent(system_tick_t timeout) {
-    LocationResults event = {LocationResults::Idle};
-    auto ret = os_queue_take(_responseQueue, &event, timeout, nullptr);
-    if (ret) {
-        event = LocationResults::Idle;
+void SomLocation::stopTracking() {
+    LocationCommandContext event {};
+    event.command = LocationCommand::StopTracking;
+    os_queue_put(_commandQueue, &event, CONCURRENT_WAIT_FOREVER, nullptr);
+}
+
+int SomLocation::subscribe(LocationTrack callback) {
+    os_mutex_lock(_fixLock);
+    SCOPE_GUARD({
+        os_mutex_unlock(_fixLock);
+    });
+
+    for (auto& subscriber : _subscribers) {
+        if (!subscriber) {
+            subscriber = callback;
+            return 0;
+        }
     }
+    return -1;
+}
 
-    return event;
+bool SomLocation::getLastFix(LocationPoint& point) {
+    os_mutex_lock(_fixLock);
+    if (_lastFixValid) {
+        point = _lastFix;
+    }
+    auto valid = _lastFixValid;
+    os_mutex_unlock(_fixLock);
+    return valid;
 }
 
-void SomLocation::stripLfCr(char* str) {
-    if (!str) {
-        return;
+bool SomLocation::copyRecentFix(LocationPoint& point, system_tick_t maxAge) {
+    os_mutex_lock(_fixLock);
+    auto recent = _lastFixValid && ((System.millis() - _lastFixMillis) <= maxAge);
+    if (recent) {
+        point = _lastFix;
     }
+    os_mutex_unlock(_fixLock);
+    return recent;
+}
 
-    auto read = str;
-    auto write = str;
+LocationTiming SomLocation::getTiming(LocationMode mode) {
+    os_mutex_lock(_fixLock);
+    auto timing = _timing[(int)mode];
+    os_mutex_unlock(_fixLock);
+    return timing;
+}
 
-    while ('\0' != *read) {
-        if (('\n' != *read) && ('\r' != *read)) {
-            *write++ = *read;
-        }
-        ++read;
+LocationCommandContext SomLocation::waitOnCommandEvent(system_tick_t timeout) {
+    LocationCommandContext event = {};
+    auto ret = os_queue_take(_commandQueue, &event, timeout, nullptr);
+    if (ret) {
+        event.command = LocationCommand::None;
+        event.point = nullptr;
     }
 
-    // Null-terminate the resulting string
-    *write = '\0';
+    return event;
 }
 
-int SomLocation::glocCallback(int type, const char* buf, int len, char* locBuffer) {
+int SomLocation::glocCallback(int type, const char* buf, int len, QlocResponse* response) {
     switch (type) {
         case TYPE_PLUS:
             // fallthrough
         case TYPE_ERROR:
-            strlcpy(locBuffer, buf, min((size_t)len, sizeof(SomLocation::_locBuffer)));
-            stripLfCr(locBuffer);
-            locationLog.trace("glocCallback: (%06x) %s", type, locBuffer);
+            locationLog.trace("glocCallback: (%06x) %.*s", type, len, buf);
+            response->result = locationParseQloc(buf, len, *response->point);
             break;
     }
 
     return WAIT;
 }
 
-int SomLocation::epeCallback(int type, const char* buf, int len, char* epeBuffer) {
+int SomLocation::epeCallback(int type, const char* buf, int len, LocationPoint* point) {
     switch (type) {
         case TYPE_PLUS:
-            // fallthrough
-        case TYPE_ERROR:
-            strlcpy(epeBuffer, buf, min((size_t)len, sizeof(SomLocation::_epeBuffer)));
-            stripLfCr(epeBuffer);
+            // Errors only mean the module may not have been initialized yet
+            locationParseEpe(buf, len, *point);
             break;
     }
 
     return WAIT;
 }
 
-CME_Error SomLocation::parseCmeError(const char* buf) {
-    unsigned int error_code = 0;
-    auto nargs = sscanf(buf," +CME ERROR: %u", &error_code);
+void SomLocation::openSession() {
+    setAntennaPower();
 
-    if (0 == nargs) {
-        return CME_Error::NONE;
+    Cellular.command(R"(AT+QGPS=1)");
+    if (_ModemType::BG95_M5 == _modemType) {
+        Cellular.command(R"(AT+QGPSCFG="nmea_epe",1)");
+        setConstellationBg95(_conf.constellations());
     }
+}
 
-    auto ret = CME_Error::UNDEFINED;
+void SomLocation::closeSession() {
+    Cellular.command(R"(AT+QGPSEND)");
+    clearAntennaPower();
+}
 
-    switch (error_code) {
-        case 504:
-            // fallthrough
-        case 505:
-            // fallthrough
-        case 506:
-            // fallthrough
-        case 516:
-            // fallthrough
-        case 522:
-            // fallthrough
-        case 549:
-            ret = static_cast<CME_Error>(error_code);
-            break;
+CME_Error SomLocation::pollFix(LocationPoint& point) {
+    // No response line leaves the result at NONE, never at a previous fix
+    QlocResponse response {&point, CME_Error::NONE};
+    Cellular.command(glocCallback, &response, 1000, R"(AT+QGPSLOC=2)");
+    if (_ModemType::BG95_M5 == _modemType) {
+        Cellular.command(epeCallback, &point, 1000, R"(AT+QGPSCFG="estimation_error")");
     }
+    return response.result;
+}
 
-    return ret;
+bool SomLocation::fixQualifies(const LocationPoint& point) const {
+    return (point.horizontalDop <= _conf.hdopThreshold()) &&
+           (point.horizontalAccuracy <= _conf.haccThreshold());
 }
 
-int SomLocation::parseQloc(const char* buf, QlocContext& context, LocationPoint& point) {
-    // The general form of the AT command response is as follows
-    // <UTC HHMMSS.hh>,<latitude (-)dd.ddddd>,<longitude (-)ddd.ddddd>,<HDOP>,<altitude>,<fix>,<COG ddd.mm>,<spkm>,<spkn>,<date DDmmyy>,<nsat>
-    auto nargs = sscanf(buf, " +QGPSLOC: %02u%02u%02u.%*03u,%lf,%lf,%f,%f,%u,%03u.%02u,%f,%f,%02u%02u%02u,%u",
-                        &context.tm_hour, &context.tm_min, &context.tm_sec,
-                        &context.latitude, &context.longitude, &context.hdop, &context.altitude,
-                        &context.fix, &context.cogDegrees, &context.cogMinutes, &context.speedKmph, &context.speedKnots,
-                        &context.tm_day, &context.tm_month, &context.tm_year,
-                        &context.nsat);
-
-    if (0 == nargs) {
-        return -1;
-    }
-
-    // Although there are several QLOC output options, we are taking the format that gives us the appropriate number of
-    // significant digits for the supported accuracy.
-    // QLOC=0 would give us ddmm.mmmmN/S, dddmm.mmmmE/W resulting in 8 significant digits for latitude and 9 in longitude
-    // QLOC=1 would give us ddmm.mmmmmm,N/S, dddmm.mmmmmm,E/W resulting in 10 significant digits for latitude and 11 in longitude
-    // QLOC=2 would give us (-)dd.ddddd, (-)ddd.ddddd resulting in 7 significant digits for latitude and 8 in longitude
-
-    // Convert tm structure to time_t (epoch time)
-    context.timeinfo.tm_year = context.tm_year + 2000 - 1900;  // GPRMC year from 2000 and then the difference from 1900
-    context.timeinfo.tm_mon = context.tm_month - 1;     // The number of months since January (0-11)
-    context.timeinfo.tm_mday = context.tm_day;
-    context.timeinfo.tm_hour = context.tm_hour;
-    context.timeinfo.tm_min = context.tm_min;
-    context.timeinfo.tm_sec = context.tm_sec;
-    point.epochTime = std::mktime(&context.timeinfo);
-
-    point.fix = context.fix;
-    point.latitude = context.latitude;
-    point.longitude = context.longitude;
-    point.altitude = context.altitude;
-    point.speed = context.speedKmph * 1000.0;
-    point.heading = (float)context.cogDegrees + (float)context.cogMinutes / 60.0;
-    point.horizontalDop = context.hdop;
-    point.satsInUse = context.nsat;
+void SomLocation::recordTtff(LocationMode mode, float ttff) {
+    os_mutex_lock(_fixLock);
+    auto& timing = _timing[(int)mode];
+    timing.sessions++;
+    timing.lastTtff = ttff;
+    timing.totalTtff += ttff;
+    if (ttff > timing.maxTtff) {
+        timing.maxTtff = ttff;
+    }
+    os_mutex_unlock(_fixLock);
+}
 
-    return 0;
+void SomLocation::recordLatency(LocationMode mode, float latency) {
+    os_mutex_lock(_fixLock);
+    auto& timing = _timing[(int)mode];
+    timing.requests++;
+    timing.lastLatency = latency;
+    timing.totalLatency += latency;
+    if (latency > timing.maxLatency) {
+        timing.maxLatency = latency;
+    }
+    os_mutex_unlock(_fixLock);
 }
 
-CME_Error SomLocation::parseQlocResponse(const char* buf, QlocContext& context, LocationPoint& point) {
-    // Only expect the following CME error codes if present
-    //   CME_Error::SESSION_IS_ONGOING - if GNSS is not enabled or ready
-    //   CME_Error::SESSION_NOT_ACTIVE - if GNSS is not enabled or ready
-    //   CME_Error::NO_FIX - if GNSS acquiring and not fixed
-    auto result = parseCmeError(buf);
+void SomLocation::storeFix(const LocationPoint& point) {
+    os_mutex_lock(_fixLock);
+    _lastFix = point;
+    _lastFixValid = true;
+    _lastFixMillis = System.millis();
+    os_mutex_unlock(_fixLock);
+}
 
-    if (CME_Error::NO_FIX == result) {
-        point.fix = 0;
-        return result; // module explicitly reported GNSS no fix
+bool SomLocation::takeRequest(LocationCommandContext& request, system_tick_t minAge) {
+    auto taken = false;
+
+    // Read the time under the lock, so no request is newer than it
+    os_mutex_lock(_fixLock);
+    auto now = System.millis();
+    for (int i = 0; i < _requestCount; i++) {
+        if ((now - _requests[i].requested) >= minAge) {
+            request = _requests[i];
+            for (int j = i + 1; j < _requestCount; j++) {
+                _requests[j - 1] = _requests[j];
+            }
+            _requests[--_requestCount] = {};
+            taken = true;
+            break;
+        }
     }
-    if (CME_Error::NONE != result) {
-        return CME_Error::NONE;  // module just may have not been initialized
+    if (0 == _requestCount) {
+        _acquiring.store(false);
     }
+    os_mutex_unlock(_fixLock);
 
-    parseQloc(buf, context, point);
-    return CME_Error::FIX;
+    return taken;
 }
 
-void SomLocation::parseEpeResponse(const char* buf, EpeContext& context, LocationPoint& point) {
-    // Only expect the following CME error codes
-    //   CME_Error::SESSION_IS_ONGOING - if GNSS is not enabled or ready
-    //   CME_Error::SESSION_NOT_ACTIVE - if GNSS is not enabled or ready
-    //   CME_Error::NO_FIX - if GNSS acquiring and not fixed
-    auto result = parseCmeError(buf);
+void SomLocation::completeRequests(LocationResults response, const LocationPoint& point, LocationMode mode, system_tick_t minAge) {
+    // One at a time, so a request attaching meanwhile is answered with the same fix
+    LocationCommandContext request;
+    auto published = false;
+    while (takeRequest(request, minAge)) {
+        *request.point = point;
+        if (LocationResults::Fixed == response) {
+            recordLatency(mode, (float)(System.millis() - request.requested) / 1000.0);
+
+            // Published once for all requests asking for it
+            if (request.publish && !published && isConnected()) {
+                locationLog.info("Publishing loc event");
+                buildPublish(_publishBuffer, sizeof(_publishBuffer), *request.point, _reqid);
+                published = Particle.publish("loc", _publishBuffer);
+                if (published) {
+                    _reqid++;
+                }
+            }
+        }
+        locationLog.trace("Sending completion");
+        if (request.doneCallback) {
+            request.doneCallback(response);
+        }
+    }
+}
 
-    if (CME_Error::NONE != result) {
-        return;  // module just may have not been initialized
+void SomLocation::acquire() {
+    openSession();
+
+    locationLog.trace("Started aquisition");
+    _acquirePoint = {};
+    auto maxTime = (uint64_t)_conf.maximumFixTime() * 1000;
+    uint64_t firstFix = {};
+    int fixCount = {};
+    LocationResults response {LocationResults::TimedOut};
+    bool power = false;
+    auto start = System.millis();
+    while ((power = isModemOn())) {
+        auto now = System.millis();
+        if ((now - start) >= maxTime)
+            break;
+        auto ret = pollFix(_acquirePoint);
+        if (CME_Error::FIX == ret) {
+            fixCount++;
+            if (0 == firstFix) {
+                firstFix = System.millis();
+                _acquirePoint.systemTime = Time.now();
+            }
+        }
+        if ((CME_Error::FIX == ret) && (LOCATION_REQUIRED_SETTLING_COUNT == fixCount) &&
+            fixQualifies(_acquirePoint)) {
+
+            response = LocationResults::Fixed;
+            break;
+        }
+        delay(LOCATION_PERIOD_ACQUIRE_MS);
     }
 
-    auto nargs = sscanf(buf, " +QGPSCFG: \"estimation_error\",%f,%f,%f,%f",
-                        &context.h_acc, &context.v_acc, &context.speed_acc, &context.head_acc);
+    closeSession();
 
-    if (nargs) {
-        point.horizontalAccuracy = context.h_acc;
-        point.verticalAccuracy = context.v_acc;
+    if (!power && (LocationResults::Fixed != response)) {
+        response = LocationResults::Unavailable;
     }
 
-    return;
+    if (firstFix) {
+        _acquirePoint.timeToFirstFix = (float)(firstFix - start) / 1000.0;
+        recordTtff(LocationMode::Single, _acquirePoint.timeToFirstFix);
+    }
+    if (LocationResults::Fixed == response) {
+        storeFix(_acquirePoint);
+    }
+
+    completeRequests(response, _acquirePoint, LocationMode::Single, 0);
+}
+
+void SomLocation::trackingStep() {
+    auto now = System.millis();
+    if ((now - _lastTrackPoll) < _conf.trackingPeriod()) {
+        return;
+    }
+    _lastTrackPoll = now;
+
+    if (!isModemOn()) {
+        // The session ends with the modem, open a new one once it is back
+        if (_sessionOpen) {
+            locationLog.info("Tracking session lost with the modem");
+            _sessionOpen = false;
+            clearAntennaPower();
+        }
+        completeRequests(LocationResults::Unavailable, _trackPoint, LocationMode::Tracking, 0);
+        return;
+    }
+
+    if (!_sessionOpen) {
+        // Waiting requests open the session before the off period ends
+        if ((now < _sessionOffUntil) && !_acquiring.load()) {
+            return;
+        }
+        openSession();
+        _sessionOpen = true;
+        _sessionFixed = false;
+        _sessionStart = now;
+        _trackFixCount = 0;
+        locationLog.trace("Tracking session opened");
+    }
+
+    auto ret = pollFix(_trackPoint);
+    if (CME_Error::FIX == ret) {
+        _trackFixCount++;
+    }
+    else {
+        _trackFixCount = 0;
+    }
+
+    if ((CME_Error::FIX == ret) && (LOCATION_REQUIRED_SETTLING_COUNT <= _trackFixCount) &&
+        fixQualifies(_trackPoint)) {
+
+        _trackPoint.systemTime = Time.now();
+        if (!_sessionFixed) {
+            _sessionFixed = true;
+            _trackPoint.timeToFirstFix = (float)(System.millis() - _sessionStart) / 1000.0;
+            recordTtff(LocationMode::Tracking, _trackPoint.timeToFirstFix);
+            locationLog.info("Tracking fix after %.1f s", _trackPoint.timeToFirstFix);
+        }
+        storeFix(_trackPoint);
+
+        // Copy the subscribers so a callback may call back into this class
+        LocationTrack subscribers[LOCATION_MAX_SUBSCRIBERS];
+        os_mutex_lock(_fixLock);
+        for (int i = 0; i < LOCATION_MAX_SUBSCRIBERS; i++) {
+            subscribers[i] = _subscribers[i];
+        }
+        os_mutex_unlock(_fixLock);
+
+        for (auto& subscriber : subscribers) {
+            if (subscriber) {
+                subscriber(_trackPoint);
+            }
+        }
+
+        completeRequests(LocationResults::Fixed, _trackPoint, LocationMode::Tracking, 0);
+    }
+    else {
+        completeRequests(LocationResults::TimedOut, _trackPoint, LocationMode::Tracking,
+                         (system_tick_t)_conf.maximumFixTime() * 1000);
+    }
+
+    // Power-cycle the session only when the duty cycle asks for it
+    if (_conf.trackingOnTime() && !_acquiring.load() &&
+        ((now - _sessionStart) >= (uint64_t)_conf.trackingOnTime() * 1000)) {
+
+        closeSession();
+        _sessionOpen = false;
+        _sessionOffUntil = now + (uint64_t)_conf.trackingOffTime() * 1000;
+        locationLog.info("Tracking session closed for %u s", _conf.trackingOffTime());
+    }
 }
 
 void SomLocation::threadLoop()
 {
     auto loop = true;
     while (loop) {
-        // Look for requests and provide a loop delay
-        auto event = waitOnCommandEvent(LOCATION_PERIOD_SUCCESS_MS);
+        // Look for requests and provide a loop delay, tracking polls at its own period
+        auto tracking = _tracking.load();
+        auto event = waitOnCommandEvent(tracking ? _conf.trackingPeriod() : LOCATION_PERIOD_SUCCESS_MS);
 
         switch (event.command) {
             case LocationCommand::None:
                 // Do nothing
                 break;
 
-            case LocationCommand::Acquire: {
-                _acquiring.store(true);
-                SCOPE_GUARD({
-                    _acquiring.store(false);
-                    clearAntennaPower();
-                });
-
-                setAntennaPower();
-
-                locationLog.trace("Started aquisition");
-                Cellular.command(R"(AT+QGPS=1)");
-                if (_ModemType::BG95_M5 == _modemType) {
-                    Cellular.command(R"(AT+QGPSCFG="nmea_epe",1)");
-                    setConstellationBg95(_conf.constellations());
-                }
-                auto maxTime = (uint64_t)_conf.maximumFixTime() * 1000;
-                uint64_t firstFix = {};
-                int fixCount = {};
-                LocationResults response {LocationResults::TimedOut};
-                bool power = false;
-                auto start = System.millis();
-                while ((power = isModemOn())) {
-                    auto now = System.millis();
-                    if ((now - start) >= maxTime)
-                        break;
-                    Cellular.command(glocCallback, _locBuffer, 1000, R"(AT+QGPSLOC=2)");
-                    auto ret = parseQlocResponse(_locBuffer, _qlocContext, *event.point);
-                    if (CME_Error::FIX == ret) {
-                        fixCount++;
-                        if (0 == firstFix) {
-                            firstFix = System.millis();
-                            event.point->systemTime = Time.now();
-                        }
-                    }
-                    if (_ModemType::BG95_M5 == _modemType) {
-                        Cellular.command(epeCallback, _epeBuffer, 1000, R"(AT+QGPSCFG="estimation_error")");
-                        parseEpeResponse(_epeBuffer, _epeContext, *event.point);
-                    }
-                    if ((CME_Error::FIX == ret) && (LOCATION_REQUIRED_SETTLING_COUNT == fixCount) &&
-                        (event.point->horizontalDop <= _conf.hdopThreshold()) &&
-                        (event.point->horizontalAccuracy <= _conf.haccThreshold())) {
-
-                        response = LocationResults::Fixed;
-                        break;
-                    }
-                    delay(LOCATION_PERIOD_ACQUIRE_MS);
-                }
-
-                Cellular.command(R"(AT+QGPSEND)");
+            case LocationCommand::Acquire:
+                // Wake-up only, the requests are in _requests
+                break;
 
-                if (!power && (LocationResults::Fixed != response)) {
-                    response = LocationResults::Unavailable;
+            case LocationCommand::StartTracking: {
+                if (!tracking) {
+                    locationLog.info("Tracking started, period %u ms", _conf.trackingPeriod());
+                    _sessionOffUntil = 0;
+                    _lastTrackPoll = 0;
+                    _tracking.store(true);
                 }
+                break;
+            }
 
-                if (firstFix)
-                    event.point->timeToFirstFix = (float)(firstFix - start) / 1000.0;
-
-                if (event.sendResponse) {
-                    locationLog.trace("Sending synchronous completion");
-                    os_queue_put(_responseQueue, &response, 0, nullptr);
-                }
-                else if (event.doneCallback) {
-                    if (event.publish && (LocationResults::Fixed == response) && isConnected()) {
-                        locationLog.info("Publishing loc event");
-                        buildPublish(_publishBuffer, sizeof(_publishBuffer), *event.point, _reqid);
-                        auto published = Particle.publish("loc", _publishBuffer);
-                        if (published) {
-                            _reqid++;
-                        }
+            case LocationCommand::StopTracking: {
+                if (tracking) {
+                    locationLog.info("Tracking stopped");
+                    _tracking.store(false);
+                    if (_sessionOpen) {
+                        closeSession();
+                        _sessionOpen = false;
                     }
-                    locationLog.trace("Sending asynchronous completion");
-                    event.doneCallback(response);
                 }
-
                 break;
             }
 
@@ -475,6 +613,14 @@ void SomLocation::threadLoop()
             default:
                 break;
         }
+
+        if (_tracking.load()) {
+            trackingStep();
+        }
+        else if (_acquiring.load()) {
+            // Requests waiting, including those left by tracking, get a session of their own
+            acquire();
+        }
     }
 
     // Kill the thread if we get here
@@ -18,10 +18,13 @@
 
 #include "location_options.h"
 #include "location_point.h"
+#include "location_parser.h"
 
 enum class LocationCommand {
     None,                   /**< Do nothing */
     Acquire,                /**< Perform GNSS acquisition */
+    StartTracking,          /**< Keep a GNSS session open and poll it continuously */
+    StopTracking,           /**< Close the tracking session */
     Exit,                   /**< Exit from thread */
 };
 
@@ -39,31 +42,53 @@ enum class LocationResults {
     TimedOut,               /**< GNSS has not fix */
 };
 
+/**
+ * @brief SomLocation acquisition modes
+ *
+ */
+enum class LocationMode {
+    Single,                 /**< One GNSS session per acquisition */
+    Tracking,               /**< Session kept open, requests served from the latest fix */
+};
+
 /**
  * @brief SomLocation class response callback prototype
  *
  */
 using LocationDone = std::function<void(LocationResults)>;
 
+/**
+ * @brief SomLocation tracking subscriber callback prototype, called from the location thread for every fix
+ *
+ */
+using LocationTrack = std::function<void(const LocationPoint&)>;
+
+constexpr int LOCATION_MAX_SUBSCRIBERS {4};
+
+/**
+ * @brief Fix timing of one acquisition mode
+ *
+ */
+struct LocationTiming {
+    unsigned int sessions;          /**< Sessions that reached a fix */
+    float lastTtff;                 /**< Time-to-first-fix of the latest session in seconds */
+    float maxTtff;                  /**< Longest time-to-first-fix in seconds */
+    float totalTtff;                /**< Sum of all time-to-first-fix values in seconds */
+    unsigned int requests;          /**< getLocation() requests answered with a fix */
+    float lastLatency;              /**< Request to fix of the latest request in seconds */
+    float maxLatency;               /**< Longest request to fix in seconds */
+    float totalLatency;             /**< Sum of all request to fix values in seconds */
+};
+
 struct LocationCommandContext {
     LocationCommand command {LocationCommand::None};
-    bool sendResponse {false};
     LocationDone doneCallback {};
     bool publish {false};
     LocationPoint* point {nullptr};
+    uint64_t requested {};              /**< System.millis() of the request */
 };
 
-enum class CME_Error {
-    NONE                  = 0,
-    FIX                   = 1,    /**< Fixed position */
-    SESSION_IS_ONGOING    = 504,  /**< Session is ongoing */
-    SESSION_NOT_ACTIVE    = 505,  /**< Session not active */
-    OPERATION_TIMEOUT     = 506,  /**< Operational timeout */
-    NO_FIX                = 516,  /**< No fix */
-    GNSS_IS_WORKING       = 522,  /**< GNSS is working */
-    UNKNOWN_ERROR         = 549,  /**< Unknown error */
-    UNDEFINED             = 999,
-};
+constexpr int LOCATION_MAX_REQUESTS {8};
 
 /**
  * @brief SomLocation class to aquire GNSS location
@@ -94,29 +119,86 @@ public:
     int begin(LocationConfiguration& configuration);
 
     /**
-     * @brief Get GNSS position, synchronously
+     * @brief Get GNSS position, synchronously. Must not be called from a location callback.
      *
      * @param point Location point with position
      * @param publish Publish location point after aquisition
+     * @param maxAge Milliseconds a previous fix may be old to be returned without an aquisition, 0 for a new fix
      * @return LocationResults
      */
-    LocationResults getLocation(LocationPoint& point, bool publish = false);
+    LocationResults getLocation(LocationPoint& point, bool publish = false, system_tick_t maxAge = 0);
 
     /**
-     * @brief Get GNSS position, asynchronously, with given callback
+     * @brief Get GNSS position, asynchronously, with given callback. Concurrent requests attach to the
+     * aquisition in progress and all receive its fix. A fix recent enough is returned at once, with the
+     * callback run before returning, and is not published again.
      *
      * @param point Location point with position
      * @param callback Callback function to call after aquisition completion
      * @param publish Publish location point after aquisition
-     * @return LocationResults
+     * @param maxAge Milliseconds a previous fix may be old to be returned without an aquisition, 0 for a new fix
+     * @retval LocationResults::Fixed Answered from a recent fix
+     * @retval LocationResults::Acquiring Request attached, the callback follows
+     * @retval LocationResults::Pending Too many requests waiting
+     */
+    LocationResults getLocation(LocationPoint& point, LocationDone callback, bool publish = false, system_tick_t maxAge = 0);
+
+    /**
+     * @brief Keep a GNSS session open and poll it every tracking period. getLocation() is then
+     * answered from the latest fix and subscribers receive every fix.
+     *
+     * @retval LocationResults::Acquiring Tracking requested
+     * @retval LocationResults::Pending Command queue is full, try again
+     * @retval LocationResults::Unavailable Modem is off
+     * @retval LocationResults::Unsupported Modem has no GNSS support
+     */
+    LocationResults startTracking();
+
+    /**
+     * @brief Close the tracking session and return to one session per acquisition
+     *
+     */
+    void stopTracking();
+
+    /**
+     * @brief Get whether tracking mode is active
+     *
+     * @return true Tracking
+     */
+    bool isTracking() const {
+        return _tracking.load();
+    }
+
+    /**
+     * @brief Add a callback for the fixes delivered in tracking mode
+     *
+     * @param callback Called from the location thread with every fix
+     * @retval 0 Success
+     * @retval -1 All subscriber slots are taken
+     */
+    int subscribe(LocationTrack callback);
+
+    /**
+     * @brief Copy the latest fix delivered in tracking mode
+     *
+     * @param point Location point with position
+     * @return true A fix was available
+     */
+    bool getLastFix(LocationPoint& point);
+
+    /**
+     * @brief Get the fix timing of an acquisition mode
+     *
+     * @param mode Acquisition mode
+     * @return LocationTiming
      */
-    LocationResults getLocation(LocationPoint& point, LocationDone callback, bool publish = false);
+    LocationTiming getTiming(LocationMode mode);
 
     /**
      * @brief Get the current acquistion state
      *
      * @retval LocationResults::Idle No current aquisition
-     * @retval LocationResults::Acquiring Aquisition in progress
+     * @retval LocationResults::Acquiring Requests are waiting for a fix
      */
     LocationResults getStatus() const {
         return (_acquiring.load()) ? LocationResults::Acquiring : LocationResults::Idle;
@@ -130,35 +212,10 @@ private:
         EG91,                           /**< EG91 modem type */
     };
 
-    struct QlocContext {
-        // QLOC parsed fields
-        unsigned int tm_hour {};
-        unsigned int tm_min {};
-        unsigned int tm_sec {};
-        unsigned int tm_day {};
-        unsigned int tm_month {};
-        unsigned int tm_year {};
-        double latitude {};
-        double longitude {};
-        unsigned int fix {};
-        float hdop {};
-        float altitude {};
-        unsigned int cogDegrees {};
-        unsigned int cogMinutes {};
-        float speedKmph {};
-        float speedKnots {};
-        unsigned int nsat {};
-
-        // Time related
-        std::tm timeinfo = {};
-    };
-
-    struct EpeContext {
-        // EPE parsed fields
-        float h_acc {};
-        float v_acc {};
-        float speed_acc {};
-        float head_acc {};
+    // Target of AT+QGPSLOC, parsed straight from the callback
+    struct QlocResponse {
+        LocationPoint* point;
+        CME_Error result;
     };
 
     SomLocation();
@@ -182,26 +239,49 @@ private:
     int setConstellationBg95(LocationConstellation flags);
 
     LocationCommandContext waitOnCommandEvent(system_tick_t timeout);
-    LocationResults waitOnResponseEvent(system_tick_t timeout);
-    static void stripLfCr(char* str);
-    static int glocCallback(int type, const char* buf, int len, char* locBuffer);
-    static int epeCallback(int type, const char* buf, int len, char* epeBuffer);
-    CME_Error parseCmeError(const char* buf);
-    int parseQloc(const char* buf, QlocContext& context, LocationPoint& point);
-    CME_Error parseQlocResponse(const char* buf, QlocContext& context, LocationPoint& point);
-    void parseEpeResponse(const char* buf, EpeContext& context, LocationPoint& point);
+    LocationResults checkModem();
+    static int glocCallback(int type, const char* buf, int len, QlocResponse* response);
+    static int epeCallback(int type, const char* buf, int len, LocationPoint* point);
+    void openSession();
+    void closeSession();
+    CME_Error pollFix(LocationPoint& point);
+    bool fixQualifies(const LocationPoint& point) const;
+    void recordTtff(LocationMode mode, float ttff);
+    void recordLatency(LocationMode mode, float latency);
+    bool copyRecentFix(LocationPoint& point, system_tick_t maxAge);
+    void storeFix(const LocationPoint& point);
+    bool takeRequest(LocationCommandContext& request, system_tick_t minAge);
+    void completeRequests(LocationResults response, const LocationPoint& point, LocationMode mode, system_tick_t minAge);
+    void acquire();
+    void trackingStep();
     void threadLoop();
     size_t buildPublish(char* buffer, size_t len, LocationPoint& point, unsigned int seq);
 
     static SomLocation* _instance;
     os_queue_t _commandQueue;
-    os_queue_t _responseQueue;
     Thread* _thread;
-    std::atomic<bool> _acquiring{false};
-    char _locBuffer[256];
-    char _epeBuffer[256];
-    QlocContext _qlocContext {};
-    EpeContext _epeContext {};
+    std::atomic<bool> _acquiring{false};    // Requests are waiting
+    std::atomic<bool> _tracking{false};
+
+    // Tracking session, owned by the location thread
+    bool _sessionOpen {false};
+    bool _sessionFixed {false};         // Delivered a fix since it was opened
+    uint64_t _sessionStart {};
+    uint64_t _sessionOffUntil {};       // Duty cycle off period
+    uint64_t _lastTrackPoll {};
+    int _trackFixCount {};
+    LocationPoint _trackPoint {};
+    LocationPoint _acquirePoint {};     // Single aquisition, copied to every request
+
+    // Shared with callers, guarded by _fixLock
+    os_mutex_t _fixLock;
+    LocationPoint _lastFix {};
+    bool _lastFixValid {false};
+    uint64_t _lastFixMillis {};
+    LocationTiming _timing[2] {};
+    LocationTrack _subscribers[LOCATION_MAX_SUBSCRIBERS];
+    LocationCommandContext _requests[LOCATION_MAX_REQUESTS];
+    int _requestCount {};
 
     LocationConfiguration _conf;
     pin_t _antennaPowerPin {PIN_INVALID};
@@ -32,6 +32,9 @@ constexpr LocationConstellation LocationConstellationDefault {LOCATION_CONST_GPS
 constexpr int LocationHdopDefault {100};
 constexpr float LocationHaccDefault {50.0}; // Meters
 constexpr unsigned int LocationFixTimeDefault {90}; // Seconds
+constexpr unsigned int LocationTrackingPeriodDefault {1000}; // Milliseconds
+constexpr unsigned int LocationTrackingOnDefault {0}; // Seconds, 0 keeps the session open
+constexpr unsigned int LocationTrackingOffDefault {0}; // Seconds
 
 /**
  * @brief LocationConfiguration class to configure Location class options
@@ -48,7 +51,10 @@ public:
         _antennaPin(PIN_INVALID),
         _hdop(LocationHdopDefault),
         _hacc(LocationHaccDefault),
-        _maxFixSeconds(LocationFixTimeDefault) {
+        _maxFixSeconds(LocationFixTimeDefault),
+        _trackingPeriodMs(LocationTrackingPeriodDefault),
+        _trackingOnSeconds(LocationTrackingOnDefault),
+        _trackingOffSeconds(LocationTrackingOffDefault) {
     }
 
     /**
@@ -161,6 +167,59 @@ public:
         return _maxFixSeconds;
     }
 
+    /**
+     * @brief Set the rate at which tracking mode polls and delivers fixes
+     *
+     * @param periodMs Milliseconds between fixes, at least 1000
+     * @return LocationConfiguration&
+     */
+    LocationConfiguration& trackingPeriod(unsigned int periodMs) {
+        if (1000 > periodMs)
+            periodMs = 1000;
+        _trackingPeriodMs = periodMs;
+        return *this;
+    }
+
+    /**
+     * @brief Get the rate at which tracking mode polls and delivers fixes
+     *
+     * @return Milliseconds between fixes
+     */
+    unsigned int trackingPeriod() const {
+        return _trackingPeriodMs;
+    }
+
+    /**
+     * @brief Set the tracking duty cycle, the GNSS session is closed for offSeconds after every onSeconds
+     *
+     * @param onSeconds Seconds the session stays open, 0 to keep it open
+     * @param offSeconds Seconds the session stays closed
+     * @return LocationConfiguration&
+     */
+    LocationConfiguration& trackingDutyCycle(unsigned int onSeconds, unsigned int offSeconds) {
+        _trackingOnSeconds = onSeconds;
+        _trackingOffSeconds = offSeconds;
+        return *this;
+    }
+
+    /**
+     * @brief Get the seconds a tracking session stays open
+     *
+     * @return Seconds, 0 when the session is kept open
+     */
+    unsigned int trackingOnTime() const {
+        return _trackingOnSeconds;
+    }
+
+    /**
+     * @brief Get the seconds a tracking session stays closed
+     *
+     * @return Seconds
+     */
+    unsigned int trackingOffTime() const {
+        return _trackingOffSeconds;
+    }
+
     LocationConfiguration& operator=(const LocationConfiguration& rhs) {
         if (this == &rhs) {
             return *this;
@@ -168,7 +227,11 @@ public:
         this->_constellations = rhs._constellations;
         this->_antennaPin = rhs._antennaPin;
         this->_hdop = rhs._hdop;
+        this->_hacc = rhs._hacc;
         this->_maxFixSeconds = rhs._maxFixSeconds;
+        this->_trackingPeriodMs = rhs._trackingPeriodMs;
+        this->_trackingOnSeconds = rhs._trackingOnSeconds;
+        this->_trackingOffSeconds = rhs._trackingOffSeconds;
 
         return *this;
     }
@@ -179,4 +242,7 @@ private:
     int _hdop;
     float _hacc;
     unsigned int _maxFixSeconds;
+    unsigned int _trackingPeriodMs;
+    unsigned int _trackingOnSeconds;
+    unsigned int _trackingOffSeconds;
 };
@@ -0,0 +1,351 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include "location_point.h"
+
+/*
+ * Parsers for the modem's GNSS responses. Each one makes a single pass over the raw
+ * response line as the AT callback hands it over (not NUL terminated, CR/LF included),
+ * with no allocation, no locale and no timezone. A line is taken only if it parses
+ * completely; anything else leaves the point untouched.
+ */
+
+enum class CME_Error {
+    NONE                  = 0,
+    FIX                   = 1,    /**< Fixed position */
+    SESSION_IS_ONGOING    = 504,  /**< Session is ongoing */
+    SESSION_NOT_ACTIVE    = 505,  /**< Session not active */
+    OPERATION_TIMEOUT     = 506,  /**< Operational timeout */
+    NO_FIX                = 516,  /**< No fix */
+    GNSS_IS_WORKING       = 522,  /**< GNSS is working */
+    UNKNOWN_ERROR         = 549,  /**< Unknown error */
+    UNDEFINED             = 999,
+};
+
+/**
+ * @brief Cursor over one response line
+ *
+ */
+class LocationTokenizer {
+public:
+    LocationTokenizer(const char* buf, size_t len) :
+        _p(buf),
+        _end(buf + len) {
+    }
+
+    /**
+     * @brief Skip spaces, and the CR/LF the modem puts around a line
+     *
+     */
+    void skipSpace() {
+        while ((_p < _end) && ((' ' == *_p) || ('\r' == *_p) || ('\n' == *_p))) {
+            ++_p;
+        }
+    }
+
+    /**
+     * @brief Consume the given text
+     *
+     * @return true The text was next
+     */
+    bool literal(const char* text) {
+        auto p = _p;
+        for (; '\0' != *text; ++text, ++p) {
+            if ((p >= _end) || (*p != *text)) {
+                return false;
+            }
+        }
+        _p = p;
+        return true;
+    }
+
+    bool comma() {
+        return literal(",");
+    }
+
+    /**
+     * @brief Only spaces or line endings are left
+     *
+     */
+    bool atEnd() {
+        skipSpace();
+        return ('\0' == peek());
+    }
+
+    /**
+     * @brief Consume exactly count digits
+     *
+     */
+    bool digits(int count, unsigned int& value) {
+        if ((_end - _p) < count) {
+            return false;
+        }
+        unsigned int result = 0;
+        for (int i = 0; i < count; i++) {
+            unsigned int digit = (unsigned char)_p[i] - '0';
+            if (9 < digit) {
+                return false;
+            }
+            result = result * 10 + digit;
+        }
+        _p += count;
+        value = result;
+        return true;
+    }
+
+    /**
+     * @brief Consume an unsigned integer of 1 to 9 digits
+     *
+     */
+    bool number(unsigned int& value) {
+        unsigned int result = 0;
+        int count = 0;
+        while (true) {
+            unsigned int digit = (unsigned char)peek() - '0';
+            if (9 < digit) {
+                break;
+            }
+            if (9 == count) {
+                return false;
+            }
+            result = result * 10 + digit;
+            ++count;
+            ++_p;
+        }
+        value = result;
+        return (0 < count);
+    }
+
+    /**
+     * @brief Consume a decimal number, [-]digits[.digits], of up to 15 digits in all.
+     * Both the gathered integer and the power of ten stay below 2^53, so they are exact
+     * and the single division rounds correctly, matching strtod(). Longer numbers are
+     * refused rather than parsed inexactly; the modem never sends more than 10 digits.
+     *
+     */
+    bool decimal(double& value) {
+        static constexpr double POW10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+            1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        };
+        auto negative = literal("-");
+        uint64_t mantissa = 0;
+        int count = 0;
+        int fraction = 0;
+        auto dot = false;
+        while (true) {
+            auto c = peek();
+            if (('.' == c) && !dot) {
+                dot = true;
+                ++_p;
+                continue;
+            }
+            unsigned int digit = (unsigned char)c - '0';
+            if (9 < digit) {
+                break;
+            }
+            if (15 == count) {
+                return false;
+            }
+            mantissa = mantissa * 10 + digit;
+            ++count;
+            if (dot) {
+                ++fraction;
+            }
+            ++_p;
+        }
+        if (0 == count) {
+            return false;
+        }
+        value = (double)mantissa / POW10[fraction];
+        if (negative) {
+            value = -value;
+        }
+        return true;
+    }
+
+    bool decimal(float& value) {
+        double result;
+        if (!decimal(result)) {
+            return false;
+        }
+        value = (float)result;
+        return true;
+    }
+
+private:
+    char peek() const {
+        return (_p < _end) ? *_p : '\0';
+    }
+
+    const char* _p;
+    const char* _end;
+};
+
+/**
+ * @brief Days from 1970-01-01 to the given proleptic Gregorian date, in constant time
+ *
+ */
+inline int64_t locationDaysFromCivil(int year, unsigned int month, unsigned int day) {
+    year -= (month <= 2) ? 1 : 0;
+    int era = ((year >= 0) ? year : (year - 399)) / 400;
+    unsigned int yearOfEra = (unsigned int)(year - era * 400);                              // [0, 399]
+    unsigned int dayOfYear = (153 * (month + ((month > 2) ? -3 : 9)) + 2) / 5 + day - 1;    // [0, 365]
+    unsigned int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;  // [0, 146096]
+    return (int64_t)era * 146097 + (int64_t)dayOfEra - 719468;
+}
+
+/**
+ * @brief Epoch time of a UTC date and time
+ *
+ */
+inline time_t locationUtcToEpoch(int year, unsigned int month, unsigned int day,
+                                 unsigned int hour, unsigned int minute, unsigned int second) {
+    return (time_t)(locationDaysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second);
+}
+
+/**
+ * @brief Parse a +CME ERROR line
+ *
+ * @return CME_Error::NONE if the line is not a CME error, CME_Error::UNDEFINED for codes not listed
+ */
+inline CME_Error locationParseCmeError(const char* buf, size_t len) {
+    LocationTokenizer tok(buf, len);
+    unsigned int code;
+    tok.skipSpace();
+    if (!tok.literal("+CME ERROR:")) {
+        return CME_Error::NONE;
+    }
+    tok.skipSpace();
+    if (!tok.number(code) || !tok.atEnd()) {
+        return CME_Error::UNDEFINED;
+    }
+
+    switch (code) {
+        case 504:
+            // fallthrough
+        case 505:
+            // fallthrough
+        case 506:
+            // fallthrough
+        case 516:
+            // fallthrough
+        case 522:
+            // fallthrough
+        case 549:
+            return static_cast<CME_Error>(code);
+    }
+
+    return CME_Error::UNDEFINED;
+}
+
+/**
+ * @brief Parse the response to AT+QGPSLOC=2
+ *
+ * The general form of the response is
+ * +QGPSLOC: <UTC HHMMSS.hh>,<latitude (-)dd.ddddd>,<longitude (-)ddd.ddddd>,<HDOP>,<altitude>,<fix>,<COG ddd.mm>,<spkm>,<spkn>,<date DDmmyy>,<nsat>
+ *
+ * QLOC=2 gives the number of significant digits that matches the supported accuracy.
+ *
+ * @retval CME_Error::FIX Position parsed into point
+ * @retval CME_Error::NO_FIX Module explicitly reported no fix, point.fix is cleared
+ * @retval CME_Error::NONE Anything else, including other CME errors (module may not be initialized yet)
+ */
+inline CME_Error locationParseQloc(const char* buf, size_t len, LocationPoint& point) {
+    auto error = locationParseCmeError(buf, len);
+    if (CME_Error::NO_FIX == error) {
+        point.fix = 0;
+        return error;
+    }
+    if (CME_Error::NONE != error) {
+        return CME_Error::NONE;
+    }
+
+    LocationTokenizer tok(buf, len);
+    unsigned int hour, minute, second, day, month, year, fraction;
+    double latitude, longitude;
+    float hdop, altitude, speedKmph, speedKnots;
+    unsigned int fix, cogDegrees, cogMinutes, nsat;
+
+    tok.skipSpace();
+    if (!tok.literal("+QGPSLOC:")) {
+        return CME_Error::NONE;
+    }
+    tok.skipSpace();
+    auto parsed = tok.digits(2, hour) && tok.digits(2, minute) && tok.digits(2, second) &&
+                  (!tok.literal(".") || tok.number(fraction)) && tok.comma() &&
+                  tok.decimal(latitude) && tok.comma() &&
+                  tok.decimal(longitude) && tok.comma() &&
+                  tok.decimal(hdop) && tok.comma() &&
+                  tok.decimal(altitude) && tok.comma() &&
+                  tok.number(fix) && tok.comma() &&
+                  tok.number(cogDegrees) && tok.literal(".") && tok.number(cogMinutes) && tok.comma() &&
+                  tok.decimal(speedKmph) && tok.comma() &&
+                  tok.decimal(speedKnots) && tok.comma() &&
+                  tok.digits(2, day) && tok.digits(2, month) && tok.digits(2, year) && tok.comma() &&
+                  tok.number(nsat) && tok.atEnd();
+    if (!parsed ||
+        (23 < hour) || (59 < minute) || (60 < second) ||
+        (1 > day) || (31 < day) || (1 > month) || (12 < month) ||
+        (90.0 < latitude) || (-90.0 > latitude) || (180.0 < longitude) || (-180.0 > longitude)) {
+
+        return CME_Error::NONE;
+    }
+
+    point.epochTime = locationUtcToEpoch(2000 + year, month, day, hour, minute, second);
+    point.fix = fix;
+    point.latitude = latitude;
+    point.longitude = longitude;
+    point.altitude = altitude;
+    point.speed = speedKmph * 1000.0;
+    point.heading = (float)cogDegrees + (float)cogMinutes / 60.0;
+    point.horizontalDop = hdop;
+    point.satsInUse = nsat;
+
+    return CME_Error::FIX;
+}
+
+/**
+ * @brief Parse the response to AT+QGPSCFG="estimation_error" into the point's accuracies
+ *
+ * @return true The estimation errors were parsed
+ */
+inline bool locationParseEpe(const char* buf, size_t len, LocationPoint& point) {
+    LocationTokenizer tok(buf, len);
+    float hAcc, vAcc, speedAcc, headAcc;
+
+    tok.skipSpace();
+    if (!tok.literal("+QGPSCFG:")) {
+        return false;
+    }
+    tok.skipSpace();
+    auto parsed = tok.literal("\"estimation_error\",") &&
+                  tok.decimal(hAcc) && tok.comma() &&
+                  tok.decimal(vAcc) && tok.comma() &&
+                  tok.decimal(speedAcc) && tok.comma() &&
+                  tok.decimal(headAcc) && tok.atEnd();
+    if (!parsed) {
+        return false;
+    }
+
+    point.horizontalAccuracy = hAcc;
+    point.verticalAccuracy = vAcc;
+    return true;
+}
@@ -0,0 +1,201 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "location_parser.h"
+
+/*
+ * The sscanf()/mktime() parsers SomLocation used before location_parser.h, kept as the
+ * reference the new parsers are checked and timed against. The bodies are unchanged
+ * apart from being free functions; the AT callback's copy and CR/LF strip is folded
+ * into parseQlocResponse() and parseEpeResponse() so both sides take the raw line.
+ * mktime() needs TZ=UTC to give the epoch time.
+ */
+namespace legacy {
+
+struct QlocContext {
+    // QLOC parsed fields
+    unsigned int tm_hour {};
+    unsigned int tm_min {};
+    unsigned int tm_sec {};
+    unsigned int tm_day {};
+    unsigned int tm_month {};
+    unsigned int tm_year {};
+    double latitude {};
+    double longitude {};
+    unsigned int fix {};
+    float hdop {};
+    float altitude {};
+    unsigned int cogDegrees {};
+    unsigned int cogMinutes {};
+    float speedKmph {};
+    float speedKnots {};
+    unsigned int nsat {};
+
+    // Time related
+    std::tm timeinfo = {};
+};
+
+struct EpeContext {
+    // EPE parsed fields
+    float h_acc {};
+    float v_acc {};
+    float speed_acc {};
+    float head_acc {};
+};
+
+static constexpr size_t LEGACY_BUFFER_SIZE = 256;
+
+inline void stripLfCr(char* str) {
+    auto read = str;
+    auto write = str;
+
+    while ('\0' != *read) {
+        if (('\n' != *read) && ('\r' != *read)) {
+            *write++ = *read;
+        }
+        ++read;
+    }
+
+    *write = '\0';
+}
+
+// What glocCallback() and epeCallback() did with the line
+inline void copyResponse(char* out, const char* buf, size_t len) {
+    auto count = (len < (LEGACY_BUFFER_SIZE - 1)) ? len : (LEGACY_BUFFER_SIZE - 1);
+    memcpy(out, buf, count);
+    out[count] = '\0';
+    stripLfCr(out);
+}
+
+inline CME_Error parseCmeError(const char* buf) {
+    unsigned int error_code = 0;
+    auto nargs = sscanf(buf," +CME ERROR: %u", &error_code);
+
+    if (0 == nargs) {
+        return CME_Error::NONE;
+    }
+
+    auto ret = CME_Error::UNDEFINED;
+
+    switch (error_code) {
+        case 504:
+            // fallthrough
+        case 505:
+            // fallthrough
+        case 506:
+            // fallthrough
+        case 516:
+            // fallthrough
+        case 522:
+            // fallthrough
+        case 549:
+            ret = static_cast<CME_Error>(error_code);
+            break;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Old QLOC parse
+ *
+ * @return Number of fields sscanf() matched, 16 for a complete line
+ */
+inline int parseQloc(const char* buf, QlocContext& context, LocationPoint& point) {
+    auto nargs = sscanf(buf, " +QGPSLOC: %02u%02u%02u.%*03u,%lf,%lf,%f,%f,%u,%03u.%02u,%f,%f,%02u%02u%02u,%u",
+                        &context.tm_hour, &context.tm_min, &context.tm_sec,
+                        &context.latitude, &context.longitude, &context.hdop, &context.altitude,
+                        &context.fix, &context.cogDegrees, &context.cogMinutes, &context.speedKmph, &context.speedKnots,
+                        &context.tm_day, &context.tm_month, &context.tm_year,
+                        &context.nsat);
+
+    if (0 == nargs) {
+        return -1;
+    }
+
+    context.timeinfo.tm_year = context.tm_year + 2000 - 1900;
+    context.timeinfo.tm_mon = context.tm_month - 1;
+    context.timeinfo.tm_mday = context.tm_day;
+    context.timeinfo.tm_hour = context.tm_hour;
+    context.timeinfo.tm_min = context.tm_min;
+    context.timeinfo.tm_sec = context.tm_sec;
+    point.epochTime = std::mktime(&context.timeinfo);
+
+    point.fix = context.fix;
+    point.latitude = context.latitude;
+    point.longitude = context.longitude;
+    point.altitude = context.altitude;
+    point.speed = context.speedKmph * 1000.0;
+    point.heading = (float)context.cogDegrees + (float)context.cogMinutes / 60.0;
+    point.horizontalDop = context.hdop;
+    point.satsInUse = context.nsat;
+
+    return nargs;
+}
+
+inline CME_Error parseQlocResponse(const char* raw, size_t len, QlocContext& context, LocationPoint& point,
+                                   int* fields = nullptr) {
+    char buf[LEGACY_BUFFER_SIZE];
+    copyResponse(buf, raw, len);
+
+    auto result = parseCmeError(buf);
+
+    if (CME_Error::NO_FIX == result) {
+        point.fix = 0;
+        return result;
+    }
+    if (CME_Error::NONE != result) {
+        return CME_Error::NONE;
+    }
+
+    auto nargs = parseQloc(buf, context, point);
+    if (fields) {
+        *fields = nargs;
+    }
+    return CME_Error::FIX;
+}
+
+/**
+ * @brief Old EPE parse
+ *
+ * @return Number of fields sscanf() matched, 4 for a complete line
+ */
+inline int parseEpeResponse(const char* raw, size_t len, EpeContext& context, LocationPoint& point) {
+    char buf[LEGACY_BUFFER_SIZE];
+    copyResponse(buf, raw, len);
+
+    auto result = parseCmeError(buf);
+
+    if (CME_Error::NONE != result) {
+        return 0;
+    }
+
+    auto nargs = sscanf(buf, " +QGPSCFG: \"estimation_error\",%f,%f,%f,%f",
+                        &context.h_acc, &context.v_acc, &context.speed_acc, &context.head_acc);
+
+    if (nargs) {
+        point.horizontalAccuracy = context.h_acc;
+        point.verticalAccuracy = context.v_acc;
+    }
+
+    return nargs;
+}
+
+} // namespace legacy
@@ -0,0 +1,69 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Time per AT+QGPSLOC=2 line of the old sscanf()/mktime() parse, including the copy and
+ * CR/LF strip the AT callback did, against locationParseQloc(). Run with `make bench`.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "location_parser.h"
+#include "legacy_parser.h"
+#include "qloc_lines.h"
+
+static constexpr int ROUNDS = 20;
+
+template <typename Parse>
+static double nsPerLine(const std::vector<std::string>& lines, Parse parse) {
+    volatile double sink = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (auto& line : lines) {
+            LocationPoint point {};
+            parse(line, point);
+            sink = sink + point.latitude;
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    (void)sink;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (ROUNDS * lines.size());
+}
+
+int main() {
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    auto lines = makeQlocLines(20000, 1);
+
+    // The first pass warms the caches and the timezone data
+    for (int pass = 0; pass < 2; pass++) {
+        auto legacyNs = nsPerLine(lines, [](const std::string& line, LocationPoint& point) {
+            legacy::QlocContext context;
+            legacy::parseQlocResponse(line.data(), line.size(), context, point);
+        });
+        auto parserNs = nsPerLine(lines, [](const std::string& line, LocationPoint& point) {
+            locationParseQloc(line.data(), line.size(), point);
+        });
+        if (pass) {
+            printf("sscanf/mktime: %.0f ns/line\n", legacyNs);
+            printf("locationParseQloc: %.0f ns/line (%.1fx)\n", parserNs, legacyNs / parserNs);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host checks of location_parser.h against the sscanf()/mktime() parsers it replaced:
+ * identical results on well-formed lines, the CME and EPE responses, the epoch
+ * arithmetic against timegm(), and a mutation fuzz. Build with `make test`, or
+ * `make sanitize` to run the fuzz under ASan/UBSan.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "location_parser.h"
+#include "legacy_parser.h"
+#include "qloc_lines.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            if (failures++ < 20) { \
+                printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            } \
+        } \
+    } while (0)
+
+static bool samePoint(const LocationPoint& a, const LocationPoint& b) {
+    return (a.fix == b.fix) &&
+           (a.epochTime == b.epochTime) &&
+           (a.latitude == b.latitude) &&
+           (a.longitude == b.longitude) &&
+           (a.altitude == b.altitude) &&
+           (a.speed == b.speed) &&
+           (a.heading == b.heading) &&
+           (a.horizontalDop == b.horizontalDop) &&
+           (a.satsInUse == b.satsInUse);
+}
+
+static void checkWellFormed(const std::vector<std::string>& lines) {
+    int mismatches = 0;
+    for (auto& line : lines) {
+        LocationPoint expected {}, actual {};
+        legacy::QlocContext context;
+        auto expectedResult = legacy::parseQlocResponse(line.data(), line.size(), context, expected);
+        auto actualResult = locationParseQloc(line.data(), line.size(), actual);
+        if ((expectedResult != actualResult) || !samePoint(expected, actual)) {
+            if (mismatches++ < 5) {
+                printf("mismatch: %s", line.c_str() + 2);
+            }
+        }
+    }
+    printf("well-formed: %zu lines, %d mismatches\n", lines.size(), mismatches);
+    CHECK(0 == mismatches);
+}
+
+static void checkCme() {
+    struct {
+        const char* line;
+        CME_Error error;
+        CME_Error qloc;
+    } cases[] = {
+        {"\r\n+CME ERROR: 516\r\n", CME_Error::NO_FIX,             CME_Error::NO_FIX},
+        {"+CME ERROR: 505",         CME_Error::SESSION_NOT_ACTIVE, CME_Error::NONE},
+        {"+CME ERROR: 12\r\n",      CME_Error::UNDEFINED,          CME_Error::NONE},
+        {"+CME ERROR: 516x",        CME_Error::UNDEFINED,          CME_Error::NONE},
+        {"+CME ERROR:",             CME_Error::UNDEFINED,          CME_Error::NONE},
+        {"OK\r\n",                  CME_Error::NONE,               CME_Error::NONE},
+        {"",                        CME_Error::NONE,               CME_Error::NONE},
+    };
+
+    for (auto& c : cases) {
+        auto len = strlen(c.line);
+        CHECK(c.error == locationParseCmeError(c.line, len));
+
+        LocationPoint point {};
+        point.fix = 3;
+        CHECK(c.qloc == locationParseQloc(c.line, len, point));
+        CHECK((CME_Error::NO_FIX == c.qloc) ? (0 == point.fix) : (3 == point.fix));
+    }
+}
+
+static void checkEpe() {
+    const char* line = "\r\n+QGPSCFG: \"estimation_error\",3.2,5.5,0.1,12.0\r\n";
+    LocationPoint expected {}, actual {};
+    legacy::EpeContext context;
+    CHECK(4 == legacy::parseEpeResponse(line, strlen(line), context, expected));
+    CHECK(locationParseEpe(line, strlen(line), actual));
+    CHECK(expected.horizontalAccuracy == actual.horizontalAccuracy);
+    CHECK(expected.verticalAccuracy == actual.verticalAccuracy);
+
+    const char* rejected[] = {
+        "+QGPSCFG: \"estimation_error\",3.2,5.5,0.1",
+        "+QGPSCFG: \"nmea_epe\",1",
+        "+CME ERROR: 505",
+    };
+    for (auto r : rejected) {
+        LocationPoint point {};
+        CHECK(!locationParseEpe(r, strlen(r), point));
+        CHECK(0.0f == point.horizontalAccuracy);
+    }
+}
+
+static void checkEpoch() {
+    int mismatches = 0;
+    for (int year = 1970; year < 2100; year++) {
+        for (unsigned int month = 1; month <= 12; month++) {
+            for (unsigned int day = 1; day <= 31; day++) {
+                std::tm timeinfo {};
+                timeinfo.tm_year = year - 1900;
+                timeinfo.tm_mon = month - 1;
+                timeinfo.tm_mday = day;
+                timeinfo.tm_hour = 23;
+                timeinfo.tm_min = 59;
+                timeinfo.tm_sec = 60;
+                if (timegm(&timeinfo) != locationUtcToEpoch(year, month, day, 23, 59, 60)) {
+                    mismatches++;
+                }
+            }
+        }
+    }
+    printf("epoch: 1970-2099, %d mismatches\n", mismatches);
+    CHECK(0 == mismatches);
+}
+
+static void checkDecimal() {
+    struct {
+        const char* text;
+        bool parsed;
+        double value;
+    } cases[] = {
+        {"0",                  true,  0.0},
+        {"-12.34567",          true,  -12.34567},
+        {"179.99999",          true,  179.99999},
+        {"0.1",                true,  0.1},
+        {"123456789012345",    true,  123456789012345.0},
+        {"12345.6789012345",   true,  12345.6789012345},
+        {"1234567890123456",   false, 0.0},
+        {"0.000000000000001",  false, 0.0},
+        {"-",                  false, 0.0},
+        {".",                  false, 0.0},
+    };
+
+    for (auto& c : cases) {
+        LocationTokenizer tok(c.text, strlen(c.text));
+        double value = 0.0;
+        auto parsed = tok.decimal(value);
+        CHECK(c.parsed == parsed);
+        if (parsed) {
+            CHECK(c.value == value);
+            CHECK(strtod(c.text, nullptr) == value);
+        }
+    }
+}
+
+// Mutated lines must never read outside the line. Those still accepted must be in range
+// and, where the old parser also matched every field, read exactly as it did.
+static void fuzz(const std::vector<std::string>& lines, long iterations) {
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> edits(1, 6);
+    long accepted = 0;
+    long compared = 0;
+    int mismatches = 0;
+
+    for (long i = 0; i < iterations; i++) {
+        auto line = lines[i % lines.size()];
+        auto count = edits(rng);
+        for (int j = 0; (j < count) && !line.empty(); j++) {
+            auto at = (size_t)byte(rng) % line.size();
+            switch (byte(rng) % 4) {
+                case 0:
+                    line[at] = (char)byte(rng);
+                    break;
+                case 1:
+                    line.erase(at, 1);
+                    break;
+                case 2:
+                    line.insert(at, 1, "0123456789.,-\r "[byte(rng) % 15]);
+                    break;
+                default:
+                    line.resize(at);
+                    break;
+            }
+        }
+
+        // Exactly sized, so ASan catches any read past the end
+        std::vector<char> exact(line.begin(), line.end());
+        LocationPoint point {};
+        if (CME_Error::FIX == locationParseQloc(exact.data(), exact.size(), point)) {
+            accepted++;
+            CHECK((-90.0 <= point.latitude) && (90.0 >= point.latitude));
+            CHECK((-180.0 <= point.longitude) && (180.0 >= point.longitude));
+
+            LocationPoint expected {};
+            legacy::QlocContext context;
+            int fields = 0;
+            legacy::parseQlocResponse(exact.data(), exact.size(), context, expected, &fields);
+            if (16 == fields) {
+                compared++;
+                if (!samePoint(expected, point)) {
+                    if (mismatches++ < 5) {
+                        printf("fuzz mismatch: %s\n", line.c_str());
+                    }
+                }
+            }
+        }
+        locationParseEpe(exact.data(), exact.size(), point);
+        locationParseCmeError(exact.data(), exact.size());
+    }
+
+    printf("fuzz: %ld mutated lines, %ld accepted, %ld compared, %d mismatches\n",
+           iterations, accepted, compared, mismatches);
+    CHECK(0 == mismatches);
+}
+
+int main(int argc, char** argv) {
+    // The old parser goes through mktime()
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    long iterations = (1 < argc) ? atol(argv[1]) : 2000000;
+    auto lines = makeQlocLines(20000, 1);
+
+    checkWellFormed(lines);
+    checkCme();
+    checkEpe();
+    checkEpoch();
+    checkDecimal();
+    fuzz(lines, iterations);
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
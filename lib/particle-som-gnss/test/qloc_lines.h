@@ -0,0 +1,50 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Well-formed AT+QGPSLOC=2 responses, as the AT callback hands them over
+ *
+ */
+inline std::vector<std::string> makeQlocLines(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> latitude(-90.0, 90.0);
+    std::uniform_real_distribution<double> longitude(-180.0, 180.0);
+    std::uniform_int_distribution<int> any(0, 1000000);
+
+    std::vector<std::string> lines;
+    lines.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        char line[160];
+        snprintf(line, sizeof(line),
+                 "\r\n+QGPSLOC: %02d%02d%02d.000,%.5f,%.5f,%.1f,%.1f,%d,%03d.%02d,%.1f,%.1f,%02d%02d%02d,%02d\r\n",
+                 any(rng) % 24, any(rng) % 60, any(rng) % 60,
+                 latitude(rng), longitude(rng),
+                 (any(rng) % 200) / 10.0, (any(rng) % 20000 - 1000) / 10.0,
+                 2 + any(rng) % 2,
+                 any(rng) % 360, any(rng) % 60,
+                 (any(rng) % 1000) / 10.0, (any(rng) % 1000) / 10.0,
+                 1 + any(rng) % 28, 1 + any(rng) % 12, any(rng) % 70,
+                 any(rng) % 40);
+        lines.push_back(line);
+    }
+
+    return lines;
+}
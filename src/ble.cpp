@@ -1,34 +1,67 @@
 #include "ble.h"
 #include "gpstime.h"
 
-// Define the target device names
-const char* TARGET_DEVICE_NAMES[] = {"nRF_01", "nRF_02", "nRF_03"};
-const int NUM_TARGET_DEVICES = 3;
-
 // Global variables
 bool isScanning = false;
 int scanCount = 0;
-int currentTargetIndex = 0;  // Round-robin index for target devices
-bool isConnected = false;
-BlePeerDevice connectedDevice;
-BleAddress targetDeviceAddress;
-bool disconnectRequested = false;
-
-// Global variables for data collection
-// Pre-allocate buffer to prevent heap fragmentation
-char dataBuffer[2048];  // Buffer for collected data
-int dataBufferPos = 0;  // Current position in buffer
-int nonZeroDataCount = 0;
+bool directConnectFailed = false;
+
+// Global variables for connections
+// Pre-allocated, collection buffers included, to prevent heap fragmentation
+PeerConnection connections[MAX_CONNECTIONS];
+
+// Global variables for the connection state machine
+os_mutex_t connectionsLock = nullptr;
+PhaseLatency phaseLatency[NUM_LINK_STATES] = {};
+const char* const LINK_STATE_NAMES[NUM_LINK_STATES] = {
+    "idle", "connecting", "discovering", "subscribing", 
+    "subscribed", "receiving", "acking", "disconnecting"
+};
+const unsigned long LINK_STATE_TIMEOUT_MS[NUM_LINK_STATES] = {
+    0, 0, 0, SUBSCRIBE_TIMEOUT_MS, 
+    FIRST_PACKET_TIMEOUT_MS, RECEIVE_TIMEOUT_MS, ACK_TIMEOUT_MS, DISCONNECT_TIMEOUT_MS
+};
+
+// Global variables for the receive path
+// Written only by the BLE callbacks, read only by receiveThreadLoop()
+NotifyRing notifyRing;
+PublishQueue publishQueue;
+uint8_t peerSavePending[PEER_REGISTRY_CAPACITY];
+int peerSavePendingCount = 0;
+Thread* receiveThread = nullptr;
+os_queue_t receiveWakeQueue = nullptr;
+
+// Global variables for scan results
+// Filled by the scan callback, one entry per device however often it advertises
+ScanEntry scanTable[SCAN_TABLE_SIZE];
+int scanTableCount = 0;
+int scanTableDropped = 0;
+// Scans run in their own thread so they overlap transfers; the main loop
+// queues a request and picks up the table once the thread reports back
+Thread* scanThread = nullptr;
+os_queue_t scanRequestQueue = nullptr;
+os_queue_t scanDoneQueue = nullptr;
+unsigned long scanStartTime = 0;
+
+// Global variables for scheduling
+// Indexed like peerRegistry
+ScanCandidate scanCandidates[PEER_REGISTRY_CAPACITY] = {};
+
+// Global variables for link tuning
+// 7.5 ms, 15 ms, 30 ms and 50 ms connection intervals
+const LinkParams LINK_PARAM_LADDER[] = {
+    {6, 0, 400},
+    {12, 0, 400},
+    {24, 0, 500},
+    {40, 0, 600}
+};
+const int NUM_LINK_LEVELS = sizeof(LINK_PARAM_LADDER) / sizeof(LINK_PARAM_LADDER[0]);
 
 // Service and characteristic UUIDs
 BleUuid serviceUuid(SERVICE_UUID);
 BleUuid dataCharUuid(DATA_CHARACTERISTIC_UUID);
 BleUuid ackCharUuid(ACK_CHARACTERISTIC_UUID);
 
-// Characteristic objects
-BleCharacteristic dataCharacteristic;
-BleCharacteristic ackCharacteristic;
-
 bool initBLE() {
     Log.info("Initializing BLE...");
     
@@ -47,15 +80,25 @@ bool initBLE() {
     // Set TX power to maximum for better range
     BLE.setTxPower(8); // Max power
     
+    // Ask for the largest ATT MTU so peripherals can pack many points per notification
+    BLE.setDesiredAttMtu(BLE_MAX_ATT_MTU_SIZE);
+    
     // Set up disconnection callback
     BLE.onDisconnected(onDisconnected, nullptr);
     
+    // Notifications are decoded, collected and published by the receive worker
+    os_mutex_create(&connectionsLock);
+    os_queue_create(&receiveWakeQueue, sizeof(uint8_t), 1, nullptr);
+    receiveThread = new Thread("ble_rx", receiveThreadLoop, OS_THREAD_PRIORITY_DEFAULT, RECEIVE_THREAD_STACK_SIZE);
+    
+    // Background scanning
+    os_queue_create(&scanRequestQueue, sizeof(uint8_t), 1, nullptr);
+    os_queue_create(&scanDoneQueue, sizeof(int8_t), 1, nullptr);
+    scanThread = new Thread("ble_scan", scanThreadLoop, OS_THREAD_PRIORITY_DEFAULT);
+    
     Log.info("BLE initialized successfully");
     Log.info("Device name: Particle_Central_01");
-    Log.info("Ready to scan for devices: %s, %s, %s", 
-             TARGET_DEVICE_NAMES[0], 
-             TARGET_DEVICE_NAMES[1], 
-             TARGET_DEVICE_NAMES[2]);
+    Log.info("Ready to scan for feathers (%d enrolled)", peerCount);
     
     return true;
 }
@@ -66,210 +109,811 @@ bool startScanning() {
         return true;
     }
     
-    // Show which device we're targeting this round
-    const char* targetDevice = TARGET_DEVICE_NAMES[currentTargetIndex];
-    Log.info("Starting BLE scan targeting: %s (device %d/%d)", 
-             targetDevice, currentTargetIndex + 1, NUM_TARGET_DEVICES);
+    Log.info("Starting BLE scan (%d feathers enrolled, %d connected)", peerCount, activeConnections());
     
-    // Reset scan count
+    // Reset scan count and the result table; nothing else touches them until
+    // the scan thread reports back. isScanning is only cleared by that report,
+    // so no earlier scan is still writing them
     scanCount = 0;
+    scanTableCount = 0;
+    scanTableDropped = 0;
+    scanStartTime = millis();
+    isScanning = true;
+    
+    uint8_t request = 1;
+    if (os_queue_put(scanRequestQueue, &request, 0, nullptr) != 0) {
+        Log.error("Failed to queue BLE scan");
+        isScanning = false;
+        return false;
+    }
+    return true;
+}
+
+void scanThreadLoop() {
+    while (true) {
+        uint8_t request;
+        if (os_queue_take(scanRequestQueue, &request, CONCURRENT_WAIT_FOREVER, nullptr) != 0) {
+            continue;
+        }
+        
+        // Blocks this thread, not the main loop, for up to SCAN_DURATION_MS or until
+        // a connection attempt stops it. Device OS drops reports without the nest
+        // service UUID before they reach onScanResult()
+        BleScanFilter filter;
+        filter.serviceUUID(serviceUuid);
+        BLE.setScanTimeout(SCAN_DURATION_MS / 10);
+        int scanResult = BLE.scanWithFilter(filter, onScanResult, nullptr);
+        
+        int8_t done = scanResult < 0 ? -1 : 0;
+        os_queue_put(scanDoneQueue, &done, CONCURRENT_WAIT_FOREVER, nullptr);
+    }
+}
+
+bool processScanResults() {
+    int8_t done;
+    if (!isScanning || os_queue_take(scanDoneQueue, &done, 0, nullptr) != 0) {
+        return false;
+    }
     
-    // Mark scan start time for duration tracking
-    unsigned long scanStartTime = millis();
+    isScanning = false;
+    Log.info("BLE scan took %lu ms", millis() - scanStartTime);
+    if (done < 0) {
+        Log.error("BLE scan failed");
+        return false;
+    }
     
-    // Use blocking scan but with a reasonable array size to prevent hanging
-    BleScanResult results[20]; // Buffer for up to 20 results
+    // Small backlogs arrive in the scan responses, collected in an idle
+    // connection's buffer; with every link busy those records come with the
+    // next connection instead. Then every feather heard goes into the
+    // candidate table, enrolling new ones.
+    PeerConnection* idle = freeConnection();
+    for (int i = 0; i < scanTableCount; i++) {
+        if (idle != nullptr) {
+            collectAdvRecords(*idle, scanTable[i]);
+        }
+        processScanResult(scanTable[i]);
+    }
+    if (scanTableDropped > 0) {
+        Log.warn("Scan table full - ignored %d reports from further devices", scanTableDropped);
+    }
     
-    // Ensure WiFi doesn't interfere with BLE scanning
-    // Small delay to let radio stabilize after any WiFi activity
-    delay(100);
+    int pending = 0;
+    for (int i = 0; i < PEER_REGISTRY_CAPACITY; i++) {
+        if (scanCandidates[i].seen && candidateHasWork(i)) {
+            pending++;
+        }
+    }
+    Log.info("Scan complete. %d reports from %d devices, %d feathers to serve", 
+             scanCount, scanTableCount, pending);
     
-    // Use callback-based scanning with timeout to prevent hanging
-    isScanning = true;
-    Vector<BleScanResult> scanResults;
+    // The main loop drains the rest, several at a time
+    serveNextCandidate();
     
-    // Start non-blocking scan with callback
-    int scanResult = BLE.scan([&scanResults](const BleScanResult& result) {
-        scanResults.append(result);
-    });
+    return true;
+}
+
+void onScanResult(const BleScanResult& result, void* context) {
+    scanCount++;
     
-    if (scanResult < 0) {
-        Log.error("Failed to start BLE scan, error: %d", scanResult);
-        isScanning = false;
+    // Runs for every report, so no allocation: find the device's entry or take a free one
+    BleAddress address = result.address();
+    int i = 0;
+    while (i < scanTableCount && scanTable[i].address != address) {
+        i++;
+    }
+    if (i == scanTableCount) {
+        if (scanTableCount == SCAN_TABLE_SIZE) {
+            scanTableDropped++;
+            return;
+        }
+        scanTable[i].address = address;
+        scanTable[i].rssi = result.rssi();
+        scanTable[i].advLen = 0;
+        scanTable[i].scanRspLen = 0;
+        scanTableCount++;
+    }
+    ScanEntry& entry = scanTable[i];
+    
+    // Strongest signal, latest payloads; reports without a scan response keep the last one
+    if (result.rssi() > entry.rssi) {
+        entry.rssi = result.rssi();
+    }
+    if (result.advertisingData().length() > 0) {
+        entry.advLen = result.advertisingData().get(entry.advData, BLE_MAX_ADV_DATA_LEN);
+    }
+    if (result.scanResponse().length() > 0) {
+        entry.scanRspLen = result.scanResponse().get(entry.scanRspData, BLE_MAX_ADV_DATA_LEN);
+    }
+}
+
+const uint8_t* findAdField(const uint8_t* data, size_t len, uint8_t type, size_t& fieldLen) {
+    // AD structures are [length][type][field], length counting the type byte
+    size_t pos = 0;
+    while (pos + 1 < len) {
+        size_t structLen = data[pos];
+        if (structLen == 0 || pos + 1 + structLen > len) {
+            break;
+        }
+        if (data[pos + 1] == type) {
+            fieldLen = structLen - 1;
+            return data + pos + 2;
+        }
+        pos += 1 + structLen;
+    }
+    fieldLen = 0;
+    return nullptr;
+}
+
+bool processScanResult(const ScanEntry& entry) {
+    int slot = peerForScanResult(entry);
+    if (slot < 0) {
         return false;
     }
     
-    // Wait for scan with timeout (5 seconds max)
-    unsigned long scanTimeout = 5000;
-    unsigned long scanStart = millis();
+    ScanCandidate& candidate = scanCandidates[slot];
+    candidate.seen = true;
+    candidate.address = entry.address;
+    candidate.rssi = entry.rssi;
+    candidate.lastSeen = millis();
+    
+    const uint8_t* advData;
+    candidate.hasStatus = readAdvStatus(entry, candidate.status, advData) > 0;
     
-    while (isScanning && (millis() - scanStart < scanTimeout)) {
-        delay(100);
-        Particle.process(); // Keep cloud connection alive
+    Log.info("Found %s (RSSI: %d dBm)", peerRegistry[slot].name, candidate.rssi);
+    if (candidate.hasStatus) {
+        Log.info("  Pending records: %u (newest #%lu)%s", candidate.status.pendingRecords, 
+                 candidate.status.lastSequence, 
+                 (candidate.status.flags & ADV_FLAG_NEEDS_TIME_SYNC) ? ", needs time sync" : "");
     }
+    return true;
+}
+
+bool candidateHasWork(int slot) {
+    const ScanCandidate& candidate = scanCandidates[slot];
     
-    // Stop scanning if still running
-    if (isScanning) {
-        BLE.stopScanning();
-        Log.warn("BLE scan timed out after %lu ms", scanTimeout);
+    // Without a backlog status we cannot tell, connect and see
+    if (!candidate.hasStatus) {
+        return true;
     }
     
-    isScanning = false;
+    // Records already published (e.g. collected from the scan response) are
+    // acknowledged by the next connection that brings new ones
+    bool hasNewRecords = candidate.status.pendingRecords > 0 && 
+                         candidate.status.lastSequence > peerRegistry[slot].syncedSequence;
+    return hasNewRecords || (candidate.status.flags & ADV_FLAG_NEEDS_TIME_SYNC);
+}
+
+int pickNextCandidate() {
+    int best = -1;
+    
+    for (int i = 0; i < PEER_REGISTRY_CAPACITY; i++) {
+        const ScanCandidate& candidate = scanCandidates[i];
+        if (!candidate.seen || millis() - candidate.lastSeen > CANDIDATE_MAX_AGE_MS || 
+            !candidateHasWork(i) || connectionForPeer(i) != nullptr) {
+            continue;
+        }
+        if (best < 0) {
+            best = i;
+            continue;
+        }
+        
+        // Feathers without a time base cannot log, then the largest backlog,
+        // then the strongest signal
+        const ScanCandidate& current = scanCandidates[best];
+        bool needsSync = candidate.hasStatus && (candidate.status.flags & ADV_FLAG_NEEDS_TIME_SYNC);
+        bool bestNeedsSync = current.hasStatus && (current.status.flags & ADV_FLAG_NEEDS_TIME_SYNC);
+        uint16_t pending = candidate.hasStatus ? candidate.status.pendingRecords : 0;
+        uint16_t bestPending = current.hasStatus ? current.status.pendingRecords : 0;
+        
+        if (needsSync != bestNeedsSync) {
+            if (needsSync) {
+                best = i;
+            }
+        } else if (pending != bestPending) {
+            if (pending > bestPending) {
+                best = i;
+            }
+        } else if (candidate.rssi > current.rssi) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+bool serveNextCandidate() {
+    if (freeConnection() == nullptr) {
+        return false;
+    }
     
-    // Log scan duration
-    unsigned long scanDuration = millis() - scanStartTime;
-    Log.info("BLE scan took %lu ms", scanDuration);
+    int slot = pickNextCandidate();
+    if (slot < 0) {
+        return false;
+    }
     
-    int resultCount = scanResults.size();
+    // One attempt per scan, whatever the outcome
+    ScanCandidate& candidate = scanCandidates[slot];
+    candidate.seen = false;
+    candidate.lastServed = millis();
     
-    Log.info("Scan complete. Found %d devices", scanResults.size());
+    Log.info("*** SERVING %s (RSSI %d dBm, seen %lu ms ago) ***", peerRegistry[slot].name, 
+             candidate.rssi, millis() - candidate.lastSeen);
+    Log.info("  Address: %02X:%02X:%02X:%02X:%02X:%02X", 
+             candidate.address[0], candidate.address[1], candidate.address[2], 
+             candidate.address[3], candidate.address[4], candidate.address[5]);
     
-    if (scanResults.size() == 0) {
-        Log.info("No devices found - trying next target device");
-        // Move to next target device in round-robin fashion
-        currentTargetIndex = (currentTargetIndex + 1) % NUM_TARGET_DEVICES;
-        return true; // Return success so we continue the cycle
+    if (connectToDevice(slot, candidate.address)) {
+        Log.info("Connection initiated successfully to %s!", peerRegistry[slot].name);
+        return true;
+    } else {
+        Log.error("Failed to initiate connection to %s", peerRegistry[slot].name);
+        return false;
+    }
+}
+
+bool connectKnownPeer() {
+    if (freeConnection() == nullptr) {
+        return false;
     }
     
-    // Process all found devices, but prioritize our current target
-    bool foundTarget = false;
-    for (int i = 0; i < scanResults.size(); i++) {
-        if (processScanResult(&scanResults[i])) {
-            foundTarget = true;
-            break; // Stop after finding and connecting to target
+    // A feather that answered its last connection advertises again as soon as
+    // it disconnects, so it can be reached by address; pick the longest waiting.
+    // Only feathers whose last advertised status shows work: records newer
+    // than the synced ones, or a time sync request.
+    int slot = -1;
+    for (int i = 0; i < PEER_REGISTRY_CAPACITY; i++) {
+        const ScanCandidate& candidate = scanCandidates[i];
+        if (!peerRegistry[i].used || !candidate.reachable || !candidate.hasStatus || !candidateHasWork(i) || 
+            millis() - candidate.lastServed < DIRECT_CONNECT_INTERVAL_MS || connectionForPeer(i) != nullptr) {
+            continue;
+        }
+        if (slot < 0 || (long)(candidate.lastServed - scanCandidates[slot].lastServed) < 0) {
+            slot = i;
         }
     }
-    
-    if (!foundTarget) {
-        Log.info("Target device %s not found - trying next target", targetDevice);
-        // Move to next target device
-        currentTargetIndex = (currentTargetIndex + 1) % NUM_TARGET_DEVICES;
+    if (slot < 0) {
+        return false;
     }
     
-    return true;
+    ScanCandidate& candidate = scanCandidates[slot];
+    Log.info("*** RECONNECTING %s without a scan (last served %lu ms ago) ***", 
+             peerRegistry[slot].name, millis() - candidate.lastServed);
+    
+    candidate.lastServed = millis();
+    
+    // If it does not answer, the state machine leaves it to the next scan
+    return connectToDevice(slot, candidate.address, true);
 }
 
-bool processScanResult(const BleScanResult* scanResult) {
-    scanCount++;
+void markServed(int slot) {
+    // The advertised status is from before the session; until the next scan
+    // reports a new one there is nothing to reconnect for
+    ScanCandidate& candidate = scanCandidates[slot];
+    candidate.status.pendingRecords = 0;
+    candidate.status.flags &= ~ADV_FLAG_NEEDS_TIME_SYNC;
+}
+
+bool directConnectPending() {
+    // Scans wait for it: stepConnect() would stop them to make the attempt
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i].state == LINK_CONNECTING && connections[i].direct) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t readAdvStatus(const ScanEntry& entry, AdvStatus& status, const uint8_t*& data) {
+    // Feathers put it in the scan response, but accept it in the advertising data too.
+    // data is pointed at the raw manufacturer data inside entry.
+    const uint8_t type = (uint8_t)BleAdvertisingDataType::MANUFACTURER_SPECIFIC_DATA;
+    size_t len;
+    data = findAdField(entry.scanRspData, entry.scanRspLen, type, len);
+    if (data != nullptr && decodeAdvStatus(data, len, status)) {
+        return len;
+    }
+    data = findAdField(entry.advData, entry.advLen, type, len);
+    return (data != nullptr && decodeAdvStatus(data, len, status)) ? len : 0;
+}
+
+bool advertisesService(const ScanEntry& entry) {
+    // The 128-bit UUID lists carry UUIDs in the same byte order as rawBytes()
+    const uint8_t types[] = {(uint8_t)BleAdvertisingDataType::SERVICE_UUID_128BIT_COMPLETE, 
+                             (uint8_t)BleAdvertisingDataType::SERVICE_UUID_128BIT_MORE_AVAILABLE};
+    const uint8_t* payloads[] = {entry.advData, entry.scanRspData};
+    const size_t lengths[] = {entry.advLen, entry.scanRspLen};
+    
+    for (int p = 0; p < 2; p++) {
+        for (uint8_t type : types) {
+            size_t len;
+            const uint8_t* uuids = findAdField(payloads[p], lengths[p], type, len);
+            for (size_t i = 0; uuids != nullptr && i + BLE_SIG_UUID_128BIT_LEN <= len; i += BLE_SIG_UUID_128BIT_LEN) {
+                if (memcmp(uuids + i, serviceUuid.rawBytes(), BLE_SIG_UUID_128BIT_LEN) == 0) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+int peerForScanResult(const ScanEntry& entry) {
+    int slot = findPeer(entry.address);
+    if (slot >= 0) {
+        return slot;
+    }
     
-    // Get device name from advertising data
-    String deviceName = scanResult->advertisingData().deviceName();
+    // Anything advertising the nest service is a feather, enrol it
+    if (!advertisesService(entry)) {
+        return -1;
+    }
     
-    // Only process devices with names
-    if (deviceName.length() == 0) {
+    // Complete name if there is one, else the address
+    char name[PEER_NAME_LEN];
+    size_t len;
+    const uint8_t* field = findAdField(entry.advData, entry.advLen, 
+                                       (uint8_t)BleAdvertisingDataType::COMPLETE_LOCAL_NAME, len);
+    if (field == nullptr) {
+        field = findAdField(entry.scanRspData, entry.scanRspLen, 
+                            (uint8_t)BleAdvertisingDataType::COMPLETE_LOCAL_NAME, len);
+    }
+    if (field != nullptr) {
+        len = min(len, (size_t)(PEER_NAME_LEN - 1));
+        memcpy(name, field, len);
+        name[len] = '\0';
+    } else {
+        snprintf(name, sizeof(name), "%02X%02X%02X%02X%02X%02X", 
+                 entry.address[5], entry.address[4], entry.address[3], 
+                 entry.address[2], entry.address[1], entry.address[0]);
+    }
+    // The receive worker reads the registry, so changes are made under the lock
+    // and written to flash by savePendingPeers()
+    os_mutex_lock(connectionsLock);
+    int enrolled = enrolPeer(entry.address, name);
+    if (enrolled >= 0) {
+        requestPeerSave(enrolled);
+    }
+    os_mutex_unlock(connectionsLock);
+    return enrolled;
+}
+
+bool collectAdvRecords(PeerConnection& conn, const ScanEntry& entry) {
+    // A feather with a link gets its records over that link, which also owns
+    // its syncedSequence; for the others only the main loop writes the entry
+    int slot = peerForScanResult(entry);
+    if (slot < 0 || connectionForPeer(slot) != nullptr) {
         return false;
     }
     
-    Log.info("Found device: %s (RSSI: %d)", deviceName.c_str(), scanResult->rssi());
+    AdvStatus status;
+    const uint8_t* advData;
+    size_t len = readAdvStatus(entry, status, advData);
+    DataPacketReader reader;
+    if (len == 0 || !openAdvRecords(reader, advData, len, status) ||
+        status.lastSequence <= peerRegistry[slot].syncedSequence) {
+        return false;
+    }
     
-    // Check if this matches our current target device
-    const char* currentTarget = TARGET_DEVICE_NAMES[currentTargetIndex];
+    Log.info("Collecting %d records up to #%lu from %s's scan response", 
+             status.pendingRecords, status.lastSequence, peerRegistry[slot].name);
     
-    if (deviceName == currentTarget || 
-        (deviceName == "nRF_0" && (String(currentTarget).startsWith("nRF_0")))) {
-        
-        Log.info("*** FOUND CURRENT TARGET: %s ***", deviceName.c_str());
-        Log.info("  Address: %02X:%02X:%02X:%02X:%02X:%02X", 
-                 scanResult->address()[0], scanResult->address()[1], 
-                 scanResult->address()[2], scanResult->address()[3], 
-                 scanResult->address()[4], scanResult->address()[5]);
-        Log.info("  RSSI: %d dBm", scanResult->rssi());
-        
-        // Save target device address for connection
-        targetDeviceAddress = scanResult->address();
-        
-        // Try to connect immediately
-        if (connectToDevice(scanResult)) {
-            Log.info("Connection initiated successfully to %s!", currentTarget);
-            return true; // Successfully found and connected to target
-        } else {
-            Log.error("Failed to initiate connection to %s", currentTarget);
-            return false;
+    // conn is idle, its collection buffer is free until the next connection
+    resetDataCollection(conn);
+    uint32_t sequence = reader.header.firstSequence;
+    DataPoint point;
+    while (readDataPoint(reader, point)) {
+        if (sequence > peerRegistry[slot].syncedSequence) {
+            collectDataPoint(conn, point);
         }
-    } else {
-        // This is not our current target device, skip it
-        Log.info("Device %s found but not current target (%s) - skipping", 
-                 deviceName.c_str(), currentTarget);
+        sequence++;
+    }
+    if (reader.remaining != 0) {
+        Log.error("Malformed scan response records from %s", peerRegistry[slot].name);
+        resetDataCollection(conn);
         return false;
     }
+    
+    os_mutex_lock(connectionsLock);
+    queueCollectedData(conn, peerRegistry[slot].name);
+    peerRegistry[slot].syncedSequence = status.lastSequence;
+    peerRegistry[slot].lastSyncTime = Time.now();
+    requestPeerSave(slot);
+    os_mutex_unlock(connectionsLock);
+    resetDataCollection(conn);
+    return true;
 }
 
 void stopScanning() {
-    // With blocking scan, there's no continuous scanning to stop
-    // This function is here for completeness
-    Log.info("stopScanning() called - using blocking scan mode");
+    // Ends the scan early; what it found is still processed once the scan
+    // thread reports back
+    if (isScanning) {
+        BLE.stopScanning();
+    }
+}
+
+int activeConnections() {
+    int count = 0;
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i].state != LINK_IDLE) {
+            count++;
+        }
+    }
+    return count;
+}
+
+PeerConnection* freeConnection() {
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i].state == LINK_IDLE) {
+            return &connections[i];
+        }
+    }
+    return nullptr;
+}
+
+PeerConnection* connectionForPeer(int peer) {
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i].state != LINK_IDLE && connections[i].peer == peer) {
+            return &connections[i];
+        }
+    }
+    return nullptr;
 }
 
-bool connectToDevice(const BleScanResult* scanResult) {
-    if (isConnected) {
-        Log.warn("Already connected to a device");
+PeerConnection* findConnection(const BleAddress& address) {
+    // Only links the receive worker may touch: connect and discovery run
+    // unlocked in the main loop
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i].state >= LINK_SUBSCRIBING && connections[i].device.address() == address) {
+            return &connections[i];
+        }
+    }
+    return nullptr;
+}
+
+bool connectToDevice(int peer, const BleAddress& address, bool direct) {
+    PeerConnection* slot = freeConnection();
+    if (slot == nullptr) {
+        Log.warn("All %d connections in use", MAX_CONNECTIONS);
         return false;
     }
-    
-    Log.info("Attempting to connect to device...");
-    
-    // Connect to the device
-    connectedDevice = BLE.connect(scanResult->address());
-    
-    if (connectedDevice.connected()) {
-        isConnected = true;
-        Log.info("Successfully connected!");
-        
-        // Reset data collection for new device
-        resetDataCollection();
-        
-        // Small delay to let connection stabilize
-        delay(500);
-        
-        // Connection established - the peripheral will request extended timeout parameters
-        Log.info("Connection established. Waiting for peripheral to negotiate timeout parameters...");
-        
-        // Give extra time for connection parameter negotiation to complete
-        // The peripheral should request extended supervision timeout
-        delay(1000);
-        
-        // Automatically discover services after connection
-        Log.info("Starting service discovery...");
+    PeerConnection& conn = *slot;
+    
+    // Claims the link; serviceConnections() makes the attempts from the main loop
+    resetDataCollection(conn);
+    conn.peer = peer;
+    conn.address = address;
+    conn.direct = direct;
+    conn.connectAttempts = 0;
+    setLinkState(conn, LINK_CONNECTING);
+    return true;
+}
+
+void serviceConnections() {
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        PeerConnection& conn = connections[i];
+        if (conn.state == LINK_IDLE) {
+            continue;
+        }
         
-        if (discoverServices()) {
-            Log.info("Service discovery complete! Ready to receive data.");
-        } else {
-            Log.error("Service discovery failed!");
-            disconnectFromDevice();
-            return false;
+        // The synchronous connect and discovery calls run unlocked, the
+        // receive worker leaves links alone until they subscribe
+        unsigned long blockedAt = millis();
+        if (conn.state == LINK_CONNECTING) {
+            stepConnect(conn);
+            os_mutex_lock(connectionsLock);
+            pauseOtherDeadlines(conn, millis() - blockedAt);
+            os_mutex_unlock(connectionsLock);
+            continue;
+        }
+        if (conn.state == LINK_DISCOVERING) {
+            bool discovered = discoverServices(conn);
+            os_mutex_lock(connectionsLock);
+            pauseOtherDeadlines(conn, millis() - blockedAt);
+            os_mutex_unlock(connectionsLock);
+            if (discovered) {
+                Log.info("Service discovery complete! Ready to receive data.");
+                os_mutex_lock(connectionsLock);
+                setLinkState(conn, LINK_SUBSCRIBING);
+                os_mutex_unlock(connectionsLock);
+            } else {
+                Log.error("Service discovery failed!");
+                os_mutex_lock(connectionsLock);
+                forceDisconnect(conn);
+                os_mutex_unlock(connectionsLock);
+            }
         }
         
-        return true;
+        // Blocking GATT calls run with the lock released, so a slow write on
+        // one link never holds up packet processing for the others
+        os_mutex_lock(connectionsLock);
+        LinkStep step;
+        planLinkStep(conn, step);
+        while (step.action != LINK_ACTION_NONE) {
+            os_mutex_unlock(connectionsLock);
+            blockedAt = millis();
+            bool ok = runLinkStep(step);
+            os_mutex_lock(connectionsLock);
+            pauseOtherDeadlines(conn, millis() - blockedAt);
+            applyLinkStep(conn, step, ok);
+        }
+        os_mutex_unlock(connectionsLock);
+    }
+}
+
+void pauseOtherDeadlines(const PeerConnection& busy, unsigned long elapsed) {
+    // Caller holds connectionsLock. The main loop was stuck in a synchronous
+    // call for busy, so no other link had its step taken meanwhile; their
+    // state timeouts do not count that time. stateEnteredAt is left alone so
+    // the latency histograms still see the real stay
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        PeerConnection& conn = connections[i];
+        if (&conn != &busy && LINK_STATE_TIMEOUT_MS[conn.state] > 0) {
+            conn.blockedMs += elapsed;
+        }
+    }
+}
+
+void planLinkStep(PeerConnection& conn, LinkStep& step) {
+    // Caller holds connectionsLock: checks the state's timeout and decides what
+    // to write, building the payload from the link as it is now
+    unsigned long timeout = LINK_STATE_TIMEOUT_MS[conn.state];
+    step.action = LINK_ACTION_NONE;
+    step.state = conn.state;
+    step.stateEnteredAt = conn.stateEnteredAt;
+    step.timedOut = timeout > 0 && millis() - conn.stateEnteredAt > timeout + conn.blockedMs;
+    step.len = 0;
+    strlcpy(step.name, peerRegistry[conn.peer].name, sizeof(step.name));
+    
+    switch (conn.state) {
+        case LINK_SUBSCRIBING:
+            // Retried every pass until it works or the state times out.
+            // Ask the peripheral to start right after the records we already have
+            step.action = LINK_ACTION_SUBSCRIBE;
+            step.len = buildSyncRequest(conn, step.payload);
+            break;
+            
+        case LINK_SUBSCRIBED:
+            if (step.timedOut) {
+                Log.warn("No packet from %s within %d ms of subscribing", step.name, FIRST_PACKET_TIMEOUT_MS);
+                phaseLatency[conn.state].timeouts++;
+                forceDisconnect(conn);
+            }
+            break;
+            
+        case LINK_RECEIVING:
+            if (step.timedOut) {
+                Log.error("Batch from %s still incomplete after %d ms", step.name, RECEIVE_TIMEOUT_MS);
+                phaseLatency[conn.state].timeouts++;
+                forceDisconnect(conn);
+            } else if (checkTransferProgress(conn)) {
+                step.len = buildNack(conn, step.payload);
+                if (step.len > 0) {
+                    step.action = LINK_ACTION_NACK;
+                }
+            }
+            break;
+            
+        case LINK_ACKING:
+            // A lost ACK leaves the data on the feather, so it is worth a few tries
+            step.action = LINK_ACTION_ACK;
+            step.len = buildAck(step.payload);
+            break;
+            
+        case LINK_DISCONNECTING:
+            if (step.timedOut) {
+                Log.warn("No disconnect event from %s after %d ms - releasing the link", step.name, DISCONNECT_TIMEOUT_MS);
+                phaseLatency[conn.state].timeouts++;
+                releaseLink(conn);
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+    if (step.action != LINK_ACTION_NONE) {
+        step.device = conn.device;
+        step.dataCharacteristic = conn.dataCharacteristic;
+        step.ackCharacteristic = conn.ackCharacteristic;
     } else {
-        Log.error("Connection failed");
+        planDisconnect(conn, step);
+    }
+}
+
+bool planDisconnect(PeerConnection& conn, LinkStep& step) {
+    // Caller holds connectionsLock. forceDisconnect() only moves the link to
+    // LINK_DISCONNECTING, the disconnect itself is sent once, without the lock
+    if (conn.state != LINK_DISCONNECTING || conn.disconnectSent) {
         return false;
     }
+    conn.disconnectSent = true;
+    step.action = LINK_ACTION_DISCONNECT;
+    step.state = conn.state;
+    step.stateEnteredAt = conn.stateEnteredAt;
+    step.device = conn.device;
+    return true;
+}
+
+bool runLinkStep(LinkStep& step) {
+    // No lock held: works on the snapshot only, the link may change meanwhile
+    switch (step.action) {
+        case LINK_ACTION_SUBSCRIBE:
+            return enableNotifications(step) && sendSyncRequest(step);
+        case LINK_ACTION_NACK:
+            return sendNack(step);
+        case LINK_ACTION_ACK:
+            return sendAckWithTimestamp(step);
+        case LINK_ACTION_DISCONNECT:
+            Log.info("Disconnecting from %s...", step.name);
+            step.device.disconnect();
+            return !step.device.connected();
+        default:
+            return true;
+    }
 }
 
-void disconnectFromDevice() {
-    if (!isConnected) {
-        Log.info("No device connected");
+void applyLinkStep(PeerConnection& conn, LinkStep& step, bool ok) {
+    // Caller holds connectionsLock again. A packet, a disconnect event or a
+    // timeout may have moved the link on while it was released; the result
+    // then no longer applies
+    LinkAction action = step.action;
+    step.action = LINK_ACTION_NONE;
+    if (conn.state != step.state || conn.stateEnteredAt != step.stateEnteredAt) {
+        planDisconnect(conn, step);
         return;
     }
     
-    Log.info("Disconnecting from device...");
+    switch (action) {
+        case LINK_ACTION_SUBSCRIBE:
+            if (ok) {
+                setLinkState(conn, LINK_SUBSCRIBED);
+            } else if (step.timedOut) {
+                Log.error("Could not subscribe to %s within %d ms", step.name, SUBSCRIBE_TIMEOUT_MS);
+                phaseLatency[conn.state].timeouts++;
+                forceDisconnect(conn);
+            }
+            break;
+            
+        case LINK_ACTION_NACK:
+            // The NACK timer restarts once the request is out
+            conn.lastPacketReceivedTime = millis();
+            break;
+            
+        case LINK_ACTION_ACK:
+            if (ok) {
+                Log.info("ACK sent successfully from main loop");
+                markServed(conn.peer);
+                forceDisconnect(conn);
+            } else if (step.timedOut) {
+                Log.warn("ACK to %s failed for %d ms - disconnecting without it", step.name, ACK_TIMEOUT_MS);
+                phaseLatency[conn.state].timeouts++;
+                forceDisconnect(conn);
+            }
+            break;
+            
+        case LINK_ACTION_DISCONNECT:
+            // Otherwise onDisconnected() or DISCONNECT_TIMEOUT_MS releases it
+            if (ok) {
+                releaseLink(conn);
+            }
+            break;
+            
+        default:
+            break;
+    }
+    planDisconnect(conn, step);
+}
+
+void setLinkState(PeerConnection& conn, LinkState state) {
+    // Every stay ends up in the histogram of the state it left
+    if (conn.state != LINK_IDLE) {
+        uint32_t elapsed = millis() - conn.stateEnteredAt;
+        PhaseLatency& latency = phaseLatency[conn.state];
+        int bucket = elapsed == 0 ? 0 : 32 - __builtin_clz(elapsed);
+        latency.buckets[min(bucket, LATENCY_BUCKETS - 1)]++;
+        latency.count++;
+        if (elapsed > latency.maxMs) {
+            latency.maxMs = elapsed;
+        }
+        Log.info("Link to %s: %s -> %s after %lu ms", peerRegistry[conn.peer].name, 
+                 LINK_STATE_NAMES[conn.state], LINK_STATE_NAMES[state], elapsed);
+    }
+    conn.state = state;
+    conn.stateEnteredAt = millis();
+    conn.blockedMs = 0;
+}
+
+void stepConnect(PeerConnection& conn) {
+    // One rung per pass: the rung that last worked for this peer, slower ones
+    // if it refuses. The ATT MTU comes from setDesiredAttMtu(); Device OS has
+    // no central-side PHY or data length call, so the peripheral requests 2M
+    // PHY and DLE itself. A direct connect gets one try: failing it usually
+    // means the feather is gone, not that the rung is too fast.
+    PeerLinkStats& stats = peerRegistry[conn.peer].link;
+    const LinkParams& params = LINK_PARAM_LADDER[stats.level];
+    
+    // The radio cannot scan and initiate at once; scanning resumes alongside
+    // the transfers with the next scan
+    stopScanning();
+    unsigned long connectTimeout = conn.direct ? DIRECT_CONNECT_TIMEOUT_MS : CONNECT_TIMEOUT_MS;
+    BLE.setScanTimeout(connectTimeout / 10);
+    Log.info("Attempting to connect to %s (interval %.2f ms, latency %d, timeout %d ms, wait %lu ms)...", 
+             peerRegistry[conn.peer].name, params.interval * 1.25, params.latency, params.timeout * 10, 
+             connectTimeout);
+    
+    // Synchronous: returns once the link is up or Device OS gives up
+    conn.device = BLE.connect(conn.address, params.interval, params.latency, params.timeout);
+    conn.connectAttempts++;
+    
+    if (conn.device.connected()) {
+        // Only feathers that answered are reconnected without a scan
+        scanCandidates[conn.peer].reachable = true;
+        Log.info("Successfully connected to %s! (%d/%d links)", peerRegistry[conn.peer].name, 
+                 activeConnections(), MAX_CONNECTIONS);
+        setLinkState(conn, LINK_DISCOVERING);
+        return;
+    }
     
-    if (connectedDevice.connected()) {
-        connectedDevice.disconnect();
+    os_mutex_lock(connectionsLock);
+    stats.connectFailures++;
+    if (!conn.direct && conn.connectAttempts < LINK_CONNECT_ATTEMPTS && stats.level + 1 < NUM_LINK_LEVELS) {
+        recordLinkFailure(conn.peer, "connection refused");
+        os_mutex_unlock(connectionsLock);
+        return;
     }
+    os_mutex_unlock(connectionsLock);
     
-    isConnected = false;
-    Log.info("Disconnected");
+    scanCandidates[conn.peer].reachable = false;
+    if (conn.direct) {
+        Log.warn("%s did not answer - it will be found by the next scan", peerRegistry[conn.peer].name);
+        directConnectFailed = true;
+    } else {
+        Log.error("Connection to %s failed", peerRegistry[conn.peer].name);
+    }
+    releaseLink(conn);
 }
 
-bool discoverServices() {
+void releaseLink(PeerConnection& conn) {
+    if (conn.state == LINK_IDLE) {
+        return;
+    }
+    // Device cleared before the state, the main loop may claim an idle link at once
+    conn.device = BlePeerDevice();
+    setLinkState(conn, LINK_IDLE);
+    Log.info("Link free for the next feather (%d/%d in use)", activeConnections(), MAX_CONNECTIONS);
+}
+
+void logPhaseLatencies() {
+    for (int state = LINK_CONNECTING; state < NUM_LINK_STATES; state++) {
+        const PhaseLatency& latency = phaseLatency[state];
+        if (latency.count == 0) {
+            continue;
+        }
+        
+        char line[192];
+        int pos = snprintf(line, sizeof(line), "%s: %lu, max %lu ms, %lu timeouts |", 
+                           LINK_STATE_NAMES[state], latency.count, latency.maxMs, latency.timeouts);
+        for (int b = 0; b < LATENCY_BUCKETS && pos < (int)sizeof(line); b++) {
+            if (latency.buckets[b] == 0) {
+                continue;
+            }
+            if (b == LATENCY_BUCKETS - 1) {
+                pos += snprintf(line + pos, sizeof(line) - pos, " >=%lu:%lu", 1UL << (b - 1), latency.buckets[b]);
+            } else {
+                pos += snprintf(line + pos, sizeof(line) - pos, " <%lu:%lu", 1UL << b, latency.buckets[b]);
+            }
+        }
+        Log.info("Latency %s", line);
+    }
+}
+
+bool discoverServices(PeerConnection& conn) {
     Log.info("Starting service discovery...");
     
     // Discover all services first
-    connectedDevice.discoverAllServices();
+    conn.device.discoverAllServices();
     
     // Get services matching our UUID
-    Vector<BleService> services = connectedDevice.getServiceByUUID(serviceUuid);
+    Vector<BleService> services = conn.device.getServiceByUUID(serviceUuid);
     
     if (services.size() == 0) {
         Log.error("Service not found! UUID: %s", SERVICE_UUID);
@@ -280,20 +924,20 @@ bool discoverServices() {
     BleService service = services[0];
     
     // Discover all characteristics for this service
-    connectedDevice.discoverAllCharacteristics();
+    conn.device.discoverAllCharacteristics();
     
     // Get data characteristic
-    bool foundDataChar = connectedDevice.getCharacteristicByUUID(service, dataCharacteristic, dataCharUuid);
+    bool foundDataChar = conn.device.getCharacteristicByUUID(service, conn.dataCharacteristic, dataCharUuid);
     if (!foundDataChar) {
         Log.error("Data characteristic not found! UUID: %s", DATA_CHARACTERISTIC_UUID);
         return false;
     }
     Log.info("Found data characteristic");
-    Log.info("Data char UUID: %s", dataCharacteristic.UUID().toString().c_str());
+    Log.info("Data char UUID: %s", conn.dataCharacteristic.UUID().toString().c_str());
     Log.info("Expected UUID: %s", DATA_CHARACTERISTIC_UUID);
     
     // Get ACK characteristic
-    bool foundAckChar = connectedDevice.getCharacteristicByUUID(service, ackCharacteristic, ackCharUuid);
+    bool foundAckChar = conn.device.getCharacteristicByUUID(service, conn.ackCharacteristic, ackCharUuid);
     if (!foundAckChar) {
         Log.error("ACK characteristic not found! UUID: %s", ACK_CHARACTERISTIC_UUID);
         return false;
@@ -305,72 +949,154 @@ bool discoverServices() {
     // The feather peripheral sets it up with WRITE property
     Log.info("ACK characteristic ready for writing");
     
-    // Small delay before enabling notifications (like nRF52 implementation)
-    delay(100);
-    
-    // Enable notifications for data characteristic
-    if (enableNotifications()) {
-        Log.info("Notifications enabled successfully!");
-    } else {
-        Log.error("Failed to enable notifications!");
-        return false;
-    }
-    
     Log.info("All services and characteristics discovered successfully!");
     
     return true;
 }
 
-bool sendAckWithTimestamp() {
-    if (!isConnected) {
-        Log.error("Cannot send ACK - not connected");
-        return false;
+size_t buildAck(uint8_t* out) {
+    // Current Unix timestamp as 4 bytes (little-endian)
+    putLe32(out, Time.now());
+    return ACK_SIZE;
+}
+
+size_t buildNack(const PeerConnection& conn, uint8_t* out) {
+    // Collect up to MAX_NACK_RANGES runs of missing packet numbers; 0 if none
+    int rangeCount = 0;
+    int packetNumber = 1;
+    
+    while (packetNumber <= conn.expectedTotalPackets && rangeCount < MAX_NACK_RANGES) {
+        if (isPacketReceived(conn, packetNumber)) {
+            packetNumber++;
+            continue;
+        }
+        
+        int first = packetNumber;
+        while (packetNumber <= conn.expectedTotalPackets && !isPacketReceived(conn, packetNumber)) {
+            packetNumber++;
+        }
+        int last = packetNumber - 1;
+        
+        uint8_t* range = &out[NACK_HEADER_SIZE + rangeCount * NACK_RANGE_SIZE];
+        putLe16(&range[0], first);
+        putLe16(&range[2], last);
+        rangeCount++;
+        
+        Log.info("  Missing packets %d-%d", first, last);
     }
     
-    // Get current Unix timestamp
-    uint32_t timestamp = Time.now();
+    if (rangeCount == 0) {
+        return 0;
+    }
     
-    Log.info("Preparing ACK with timestamp: %lu", timestamp);
+    out[0] = NACK_OPCODE;
+    out[1] = rangeCount;
+    return NACK_HEADER_SIZE + rangeCount * NACK_RANGE_SIZE;
+}
+
+size_t buildSyncRequest(const PeerConnection& conn, uint8_t* out) {
+    // 0 lets the peripheral send everything it has not had acknowledged
+    uint32_t fromSequence = peerRegistry[conn.peer].syncedSequence;
+    if (fromSequence != 0) {
+        fromSequence++;
+    }
     
-    // Write timestamp as 4 bytes (little-endian)
-    uint8_t timestampBytes[4];
-    timestampBytes[0] = (timestamp) & 0xFF;
-    timestampBytes[1] = (timestamp >> 8) & 0xFF;
-    timestampBytes[2] = (timestamp >> 16) & 0xFF;
-    timestampBytes[3] = (timestamp >> 24) & 0xFF;
+    out[0] = SYNC_OPCODE;
+    putLe32(&out[1], fromSequence);
+    return SYNC_REQUEST_SIZE;
+}
+
+bool sendAckWithTimestamp(LinkStep& step) {
+    uint32_t timestamp = getLe32(step.payload);
     
     // Check if ACK characteristic is valid before writing
-    if (!ackCharacteristic.UUID().isValid()) {
+    if (!step.ackCharacteristic.UUID().isValid()) {
         Log.error("ACK characteristic UUID is invalid!");
         return false;
     }
     
-    Log.info("Writing %d bytes to ACK characteristic (UUID: %s)...", 
-             sizeof(timestampBytes), ackCharacteristic.UUID().toString().c_str());
+    Log.info("Writing ACK with timestamp %lu to %s...", timestamp, step.name);
     
     // Track write timing for debugging
     unsigned long writeStartTime = millis();
     
-    // Try the ACK write - this is where it may hang
-    int result = ackCharacteristic.setValue(timestampBytes, sizeof(timestampBytes));
+    // Synchronous write; a failure is retried by the state machine until ACK_TIMEOUT_MS
+    int result = step.ackCharacteristic.setValue(step.payload, step.len);
     
     unsigned long writeTime = millis() - writeStartTime;
-    Log.info("ACK write completed in %lu ms, result: %d", writeTime, result);
     
-    if (result == sizeof(timestampBytes)) {
-        Log.info("ACK sent successfully with timestamp %lu", timestamp);
+    if (result == (int)step.len) {
+        Log.info("ACK sent successfully with timestamp %lu in %lu ms", timestamp, writeTime);
+        return true;
+    } else {
+        Log.error("ACK write failed after %lu ms - result: %d (expected: %d)", writeTime, result, step.len);
+        return false;
+    }
+}
+
+bool sendNack(LinkStep& step) {
+    int result = step.ackCharacteristic.setValue(step.payload, step.len);
+    if (result == (int)step.len) {
+        Log.info("NACK sent to %s for %d range(s)", step.name, step.payload[1]);
         return true;
     } else {
-        Log.error("ACK write failed - result: %d (expected: %d)", result, sizeof(timestampBytes));
+        Log.error("NACK write failed - result: %d (expected: %d)", result, step.len);
         return false;
     }
 }
 
-bool enableNotifications() {
+bool sendSyncRequest(LinkStep& step) {
+    int result = step.ackCharacteristic.setValue(step.payload, step.len);
+    if (result == (int)step.len) {
+        Log.info("Sync requested from %s at sequence %lu", step.name, getLe32(&step.payload[1]));
+        return true;
+    } else {
+        Log.error("Sync request write failed - result: %d (expected: %d)", result, step.len);
+        return false;
+    }
+}
+
+bool checkTransferProgress(PeerConnection& conn) {
+    // Caller holds connectionsLock; true when a NACK round is due
+    // Nothing to do until a batch is under way
+    if (conn.expectedTotalPackets == 0 || conn.receivedPacketCount >= conn.expectedTotalPackets) {
+        return false;
+    }
+    
+    // The peripheral went quiet with packets still missing
+    if (!conn.nackRequested && millis() - conn.lastPacketReceivedTime > NACK_TIMEOUT_MS) {
+        Log.warn("No packets from %s for %d ms - %d/%d received", peerRegistry[conn.peer].name, 
+                 NACK_TIMEOUT_MS, conn.receivedPacketCount, conn.expectedTotalPackets);
+        conn.nackRequested = true;
+    }
+    
+    if (!conn.nackRequested) {
+        return false;
+    }
+    conn.nackRequested = false;
+    
+    if (conn.nackRounds >= MAX_NACK_ROUNDS) {
+        Log.error("Batch still incomplete after %d NACKs - disconnecting without ACK", conn.nackRounds);
+        forceDisconnect(conn);
+        return false;
+    }
+    
+    conn.nackRounds++;
+    conn.lastPacketReceivedTime = millis();
+    Log.info("Requesting retransmission (round %d/%d)", conn.nackRounds, MAX_NACK_ROUNDS);
+    return true;
+}
+
+bool isPacketReceived(const PeerConnection& conn, int packetNumber) {
+    int bit = packetNumber - 1;
+    return (conn.receivedPacketBitmap[bit / 8] & (1 << (bit % 8))) != 0;
+}
+
+bool enableNotifications(LinkStep& step) {
     Log.info("Enabling notifications on data characteristic...");
     
     // First check if the characteristic supports notifications
-    uint8_t properties = dataCharacteristic.properties();
+    uint8_t properties = step.dataCharacteristic.properties();
     Log.info("Data characteristic properties: 0x%02X", properties);
     Log.info("Expected properties: READ (0x02) | NOTIFY (0x10) = 0x12");
     
@@ -382,8 +1108,8 @@ bool enableNotifications() {
     if (properties & 0x10) Log.info("  - NOTIFY supported");
     if (properties & 0x20) Log.info("  - INDICATE supported");
     
-    // Set up the notification callback first
-    dataCharacteristic.onDataReceived(onDataReceived, &dataCharacteristic);
+    // Set up the notification callback first; it finds the connection from the peer
+    step.dataCharacteristic.onDataReceived(onDataReceived, nullptr);
     
     // Try to subscribe regardless of properties check
     // Some implementations don't report properties correctly
@@ -391,234 +1117,486 @@ bool enableNotifications() {
     
     // Enable notifications using subscribe
     // subscribe() returns the number of bytes written to CCCD, not a boolean
-    int result = dataCharacteristic.subscribe(true);
+    int result = step.dataCharacteristic.subscribe(true);
     
     if (result == SYSTEM_ERROR_NONE || result > 0) {
         Log.info("Successfully subscribed to notifications (result: %d)", result);
         return true;
     } else {
+        // No retry here, the state machine tries again on the next pass
         Log.error("Failed to subscribe to notifications, error: %d", result);
-        
-        // Try again with a delay
-        delay(100);
-        result = dataCharacteristic.subscribe(true);
-        
-        if (result == SYSTEM_ERROR_NONE || result > 0) {
-            Log.info("Successfully subscribed on second attempt (result: %d)", result);
-            return true;
-        } else {
-            Log.error("Second subscribe attempt also failed, error: %d", result);
-            
-            // Log more details about the characteristic
-            Log.info("Characteristic UUID: %s", dataCharacteristic.UUID().toString().c_str());
-            
-            return false;
-        }
+        Log.info("Characteristic UUID: %s", step.dataCharacteristic.UUID().toString().c_str());
+        return false;
     }
 }
 
 void onDataReceived(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context) {
-    static unsigned long lastPacketTime = millis();
-    static int lastPacketNumber = 0;
-    static int consecutiveTimeouts = 0;
-    
-    // Special case: reset static variables on new connection
-    if (!isConnected) {
-        lastPacketNumber = 0;
-        consecutiveTimeouts = 0;
-        lastPacketTime = millis();
-        return;
+    // BLE thread: copy and return, the receive worker does the rest
+    pushNotification(NOTIFY_EVENT_DATA, peer.address(), data, len);
+}
+
+void onDisconnected(const BlePeerDevice& peer, void* context) {
+    // Queued behind the link's last notifications, so they are handled first
+    pushNotification(NOTIFY_EVENT_DISCONNECTED, peer.address(), nullptr, 0);
+}
+
+bool pushNotification(NotifyEventType type, const BleAddress& address, const uint8_t* data, size_t len) {
+    uint32_t head = notifyRing.head.load(std::memory_order_relaxed);
+    if (head - notifyRing.tail.load(std::memory_order_acquire) >= NOTIFY_RING_SIZE || 
+        len > MAX_NOTIFY_PAYLOAD) {
+        notifyRing.dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
     
-    Log.info("Data received! Length: %d bytes", len);
+    RawNotification& slot = notifyRing.slots[head & (NOTIFY_RING_SIZE - 1)];
+    slot.type = type;
+    slot.len = len;
+    slot.address = address;
+    if (len > 0) {
+        memcpy(slot.data, data, len);
+    }
+    notifyRing.head.store(head + 1, std::memory_order_release);
+    
+    // Never blocks: a pending wake-up already covers this event
+    uint8_t wake = 1;
+    os_queue_put(receiveWakeQueue, &wake, 0, nullptr);
+    return true;
+}
+
+RawNotification* peekNotification() {
+    uint32_t tail = notifyRing.tail.load(std::memory_order_relaxed);
+    if (tail == notifyRing.head.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    return &notifyRing.slots[tail & (NOTIFY_RING_SIZE - 1)];
+}
+
+void popNotification() {
+    notifyRing.tail.store(notifyRing.tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void receiveThreadLoop() {
+    uint32_t reportedDrops = 0;
     
-    // Check for packet timeout (if no packets received for 3 seconds, connection likely lost)
-    if (millis() - lastPacketTime > 3000 && lastPacketNumber > 0) {
-        consecutiveTimeouts++;
-        Log.warn("Packet timeout detected - connection may be lost (timeout count: %d)", consecutiveTimeouts);
+    while (true) {
+        uint8_t wake;
+        if (os_queue_take(receiveWakeQueue, &wake, CONCURRENT_WAIT_FOREVER, nullptr) != 0) {
+            continue;
+        }
         
-        // If we get 2 consecutive timeouts, force disconnect
-        if (consecutiveTimeouts >= 2) {
-            Log.error("Multiple timeouts detected - forcing disconnect");
-            forceDisconnect();
-            return;
+        // Drain everything, the slot is only handed back once it is processed
+        RawNotification* event;
+        while ((event = peekNotification()) != nullptr) {
+            os_mutex_lock(connectionsLock);
+            PeerConnection* conn = findConnection(event->address);
+            if (conn != nullptr) {
+                if (event->type == NOTIFY_EVENT_DATA) {
+                    processNotification(*conn, event->data, event->len);
+                } else {
+                    handleDisconnect(*conn);
+                }
+            }
+            os_mutex_unlock(connectionsLock);
+            popNotification();
+        }
+        
+        uint32_t dropped = notifyRing.dropped.load(std::memory_order_relaxed);
+        if (dropped != reportedDrops) {
+            Log.warn("Receive ring full - %lu BLE events dropped so far", dropped);
+            reportedDrops = dropped;
         }
-    } else {
-        consecutiveTimeouts = 0;  // Reset timeout counter on successful packet
     }
-    lastPacketTime = millis();
+}
+
+void processNotification(PeerConnection& conn, const uint8_t* data, size_t len) {
+    const char* deviceName = peerRegistry[conn.peer].name;
     
-    // BLE adds some overhead, so accept packets between 14-20 bytes for our single-point packets
-    if (len < 14 || len > 20) {
-        Log.error("Invalid packet size: %d bytes", len);
+    // Packets can beat the sync request; once the batch is complete, repeats are ignored
+    if (conn.state != LINK_SUBSCRIBING && conn.state != LINK_SUBSCRIBED && conn.state != LINK_RECEIVING) {
         return;
     }
     
-    // Parse the DataPacket
-    DataPacket* packet = (DataPacket*)data;
+    // Per-packet logs are trace level: with several links streaming they would
+    // cost more than decoding; the batch summary below stays at info
+    Log.trace("Data received from %s! Length: %d bytes", deviceName, len);
     
-    // Check for packet sequence issues
-    if (lastPacketNumber > 0 && packet->packetNumber != lastPacketNumber + 1) {
-        if (packet->packetNumber == 1) {
-            Log.warn("Packet sequence restarted! Previous packet: %d, Current: %d", lastPacketNumber, packet->packetNumber);
-            Log.warn("Peripheral may have reset - clearing data collection");
-            resetDataCollection();
-        } else {
-            Log.error("Packet sequence error! Expected: %d, Received: %d", lastPacketNumber + 1, packet->packetNumber);
-        }
+    // Packets are variable length, but always carry at least the header
+    if (len < DATA_PACKET_HEADER_SIZE) {
+        Log.error("Invalid packet size: %d bytes", len);
+        return;
+    }
+    DataPacketReader reader;
+    if (!openDataPacket(reader, data, len)) {
+        Log.error("Unsupported or truncated packet: version %d format %d (expected version %d)", 
+                  data[0], data[1], NEST_PROTOCOL_VERSION);
+        return;
     }
+    const DataPacketHeader& packet = reader.header;
     
-    // Update last packet tracking
-    lastPacketNumber = packet->packetNumber;
+    // Notification sizes reveal the negotiated MTU, their timing the throughput
+    PeerLinkStats& stats = peerRegistry[conn.peer].link;
+    if (len > stats.maxPacketLength) {
+        stats.maxPacketLength = len;
+    }
+    if (conn.transferBytes == 0) {
+        conn.transferStartTime = millis();
+    }
+    conn.transferBytes += len;
     
-    Log.info("Packet %d/%d received", packet->packetNumber, packet->totalPackets);
-    Log.info("Points in packet: %d", packet->pointsInPacket);
+    if (packet.packetNumber == 0 || packet.packetNumber > packet.totalPackets ||
+        packet.totalPackets > MAX_BATCH_PACKETS) {
+        Log.error("Invalid packet number: %d/%d", packet.packetNumber, packet.totalPackets);
+        return;
+    }
+    
+    // A different batch size means the peripheral restarted its upload
+    if (conn.expectedTotalPackets != 0 && packet.totalPackets != conn.expectedTotalPackets) {
+        Log.warn("Batch size changed from %d to %d packets", conn.expectedTotalPackets, packet.totalPackets);
+        Log.warn("Peripheral may have reset - clearing data collection");
+        resetDataCollection(conn);
+    }
+    conn.expectedTotalPackets = packet.totalPackets;
+    conn.lastPacketReceivedTime = millis();
+    if (conn.state != LINK_RECEIVING) {
+        setLinkState(conn, LINK_RECEIVING);
+    }
     
-    // For BLE notifications, the actual data might be padded to 20 bytes
-    // but our packet structure is only 14 bytes for single point packets
-    size_t minExpectedSize = 5 + (packet->pointsInPacket * sizeof(DataPoint));
-    if (len < minExpectedSize) {
-        Log.error("Packet too small. Expected at least: %d, Received: %d", minExpectedSize, len);
+    // Retransmissions may repeat packets we already have
+    if (isPacketReceived(conn, packet.packetNumber)) {
+        Log.trace("Duplicate packet %d ignored", packet.packetNumber);
         return;
     }
     
+    Log.trace("Packet %d/%d received, %d points (%s encoding)", packet.packetNumber, packet.totalPackets,
+              packet.pointsInPacket, packet.format == PACKET_FORMAT_DELTA ? "delta" : "raw");
+    
+    // Remember where this packet's points start so a malformed packet can be dropped
+    int packetBufferStart = conn.dataBufferPos;
+    int packetNonZeroStart = conn.nonZeroDataCount;
+    
     // Process each data point in the packet
-    for (int i = 0; i < packet->pointsInPacket; i++) {
-        DataPoint* point = &packet->points[i];
-        Log.info("  Point %d: val1=%d, val2=%lu, val3=%lu", 
-                 i + 1, point->val1, point->val2, point->val3);
-        
-        // Collect non-zero data points
-        if (point->val1 != 0 || point->val2 != 0 || point->val3 != 0) {
-            // Add to collected data buffer
-            if (dataBufferPos > 0 && dataBufferPos < (int)(sizeof(dataBuffer) - 1)) {
-                dataBuffer[dataBufferPos++] = ',';
-            }
-            
-            // Format data point into buffer
-            int written = snprintf(dataBuffer + dataBufferPos, 
-                                 sizeof(dataBuffer) - dataBufferPos,
-                                 "%d:%lu:%lu", point->val1, point->val2, point->val3);
-            
-            if (written > 0 && dataBufferPos + written < (int)sizeof(dataBuffer)) {
-                dataBufferPos += written;
-            }
-            
-            nonZeroDataCount++;
-            Log.info("    Non-zero data point collected (total: %d)", nonZeroDataCount);
-        }
+    DataPoint point;
+    int pointIndex = 0;
+    while (readDataPoint(reader, point)) {
+        pointIndex++;
+        Log.trace("  Point %d: val1=%d, val2=%lu, val3=%lu", 
+                 pointIndex, point.val1, point.val2, point.val3);
+        collectDataPoint(conn, point);
+    }
+    
+    // Drop the whole packet and leave it unmarked so the NACK round fetches it again
+    if (reader.remaining != 0) {
+        Log.error("Malformed packet %d: %d points could not be decoded", 
+                  packet.packetNumber, reader.remaining);
+        conn.dataBufferPos = packetBufferStart;
+        conn.dataBuffer[conn.dataBufferPos] = '\0';
+        conn.nonZeroDataCount = packetNonZeroStart;
+        conn.nackRequested = true;
+        return;
+    }
+    
+    int bit = packet.packetNumber - 1;
+    conn.receivedPacketBitmap[bit / 8] |= 1 << (bit % 8);
+    conn.receivedPacketCount++;
+    
+    // Points carry consecutive sequence numbers, the highest packet holds the newest
+    uint32_t packetLastSequence = packet.firstSequence + packet.pointsInPacket - 1;
+    if (conn.receivedPacketCount == 1 || packetLastSequence > conn.receivedLastSequence) {
+        conn.receivedLastSequence = packetLastSequence;
+    }
+    
+    // The buffer boundary is only exact while no packet past a gap is in it
+    int prefixPackets = conn.committedPackets;
+    while (prefixPackets < conn.expectedTotalPackets && isPacketReceived(conn, prefixPackets + 1)) {
+        prefixPackets++;
+    }
+    if (prefixPackets == conn.receivedPacketCount) {
+        conn.committedPackets = prefixPackets;
+        conn.committedBufferPos = conn.dataBufferPos;
+        conn.committedDataCount = conn.nonZeroDataCount;
+        conn.committedLastSequence = conn.receivedLastSequence;
     }
     
-    // Check if this is the last packet
-    if (packet->packetNumber == packet->totalPackets) {
-        Log.info("All packets received! Total: %d", packet->totalPackets);
+    if (conn.expectedTotalPackets == 1 && packet.pointsInPacket == 0) {
+        // Header-only batch: the peripheral has nothing logged, just ACK it
+        Log.info("%s has no new records", deviceName);
+        setLinkState(conn, LINK_ACKING);
+        
+    } else if (conn.receivedPacketCount == conn.expectedTotalPackets) {
+        Log.info("Batch from %s complete: %d packets, records synced up to sequence %lu", 
+                 deviceName, conn.expectedTotalPackets, conn.receivedLastSequence);
+        peerRegistry[conn.peer].syncedSequence = conn.receivedLastSequence;
+        peerRegistry[conn.peer].lastSyncTime = Time.now();
+        recordLinkSuccess(conn);  // Also queues the peer for saving
         
-        Log.info("Data transfer complete. All packets received successfully!");
+        // Queue collected non-zero data points, the main loop publishes them
+        queueCollectedData(conn, deviceName);
         
-        // Publish collected non-zero data points immediately
-        const char* deviceName = TARGET_DEVICE_NAMES[currentTargetIndex];
-        publishCollectedData(deviceName);
+        // DON'T send ACK or disconnect from callback - the main loop does it
+        setLinkState(conn, LINK_ACKING);
         
-        // DON'T send ACK or disconnect from callback - set flag for main loop
-        Log.info("Queuing disconnect after data transfer complete");
-        disconnectRequested = true;
+    } else if (packet.packetNumber == packet.totalPackets) {
+        // Last packet arrived with gaps - main loop sends the NACK
+        Log.error("Packet sequence error! Batch ended with %d/%d packets", 
+                  conn.receivedPacketCount, conn.expectedTotalPackets);
+        conn.nackRequested = true;
         
     } else {
-        Log.info("Waiting for more packets... (%d/%d)", packet->packetNumber, packet->totalPackets);
+        Log.trace("Waiting for more packets... (%d/%d)", conn.receivedPacketCount, conn.expectedTotalPackets);
     }
 }
 
-void onDisconnected(const BlePeerDevice& peer, void* context) {
+void handleDisconnect(PeerConnection& conn) {
     Log.info("=== DISCONNECTED FROM PERIPHERAL ===");
     Log.info("Device address: %02X:%02X:%02X:%02X:%02X:%02X", 
-             peer.address()[0], peer.address()[1], peer.address()[2], 
-             peer.address()[3], peer.address()[4], peer.address()[5]);
+             conn.address[0], conn.address[1], conn.address[2], 
+             conn.address[3], conn.address[4], conn.address[5]);
     
-    // Reset connection state
-    isConnected = false;
+    // Keep whatever arrived in order, the next connection resumes after it.
+    // Nothing is left when forceDisconnect() initiated it
+    publishPartialBatch(conn);
+    releaseLink(conn);
     
-    // Clear the connected device
-    connectedDevice = BlePeerDevice();
-    
-    // Move to next target device for round-robin cycling
-    const char* previousTarget = TARGET_DEVICE_NAMES[currentTargetIndex];
-    currentTargetIndex = (currentTargetIndex + 1) % NUM_TARGET_DEVICES;
-    const char* nextTarget = TARGET_DEVICE_NAMES[currentTargetIndex];
-    
-    Log.info("Data collection from %s complete. Next target: %s", previousTarget, nextTarget);
-    Log.info("Connection state reset. Will resume scanning for next device...");
+    Log.info("Data collection from %s complete", peerRegistry[conn.peer].name);
+    Log.info("Connection state reset. Will serve the next candidate or scan again...");
 }
 
-void forceDisconnect() {
-    if (!isConnected) {
-        Log.info("No device connected to disconnect");
+void forceDisconnect(PeerConnection& conn) {
+    if (conn.state == LINK_IDLE || conn.state == LINK_DISCONNECTING) {
         return;
     }
     
-    Log.info("Forcing disconnection from device...");
+    // Keep whatever arrived in order when giving up on an incomplete batch;
+    // published first, so onDisconnected() has nothing left to publish
+    publishPartialBatch(conn);
     
-    if (connectedDevice.connected()) {
-        Log.info("Device reports as connected - sending disconnect command...");
-        connectedDevice.disconnect();
-        Log.info("Disconnect command sent");
-        delay(100); // Give time for disconnect to process
-    } else {
+    if (!conn.device.connected()) {
         Log.info("Device already reports as disconnected");
+        releaseLink(conn);
+        return;
     }
     
-    // Only NOW set connection state to false (after disconnect command)
-    isConnected = false;
-    Log.info("Connection state reset to false");
-    
-    // Clear the connected device object
-    connectedDevice = BlePeerDevice();
-    Log.info("Connected device object cleared");
-    
-    Log.info("Force disconnect complete - ready to resume scanning");
+    // The link stays claimed until onDisconnected() or DISCONNECT_TIMEOUT_MS.
+    // serviceConnections() calls disconnect() once the lock is released
+    setLinkState(conn, LINK_DISCONNECTING);
+    conn.disconnectSent = false;
 }
 
-void resetDataCollection() {
-    memset(dataBuffer, 0, sizeof(dataBuffer));
-    dataBufferPos = 0;
-    nonZeroDataCount = 0;
+void resetDataCollection(PeerConnection& conn) {
+    memset(conn.dataBuffer, 0, sizeof(conn.dataBuffer));
+    conn.dataBufferPos = 0;
+    conn.nonZeroDataCount = 0;
+    memset(conn.receivedPacketBitmap, 0, sizeof(conn.receivedPacketBitmap));
+    conn.expectedTotalPackets = 0;
+    conn.receivedPacketCount = 0;
+    conn.lastPacketReceivedTime = millis();
+    conn.nackRounds = 0;
+    conn.nackRequested = false;
+    conn.disconnectSent = false;
+    conn.transferBytes = 0;
+    conn.receivedLastSequence = 0;
+    conn.committedPackets = 0;
+    conn.committedBufferPos = 0;
+    conn.committedDataCount = 0;
+    conn.committedLastSequence = 0;
     Log.info("Data collection reset for new device");
 }
 
-void publishCollectedData(const char* deviceName) {
-    if (nonZeroDataCount == 0) {
+void collectDataPoint(PeerConnection& conn, const DataPoint& point) {
+    // Collect non-zero data points
+    if (point.val1 == 0 && point.val2 == 0 && point.val3 == 0) {
+        return;
+    }
+    
+    // Add to collected data buffer
+    if (conn.dataBufferPos > 0 && conn.dataBufferPos < (int)(sizeof(conn.dataBuffer) - 1)) {
+        conn.dataBuffer[conn.dataBufferPos++] = ',';
+    }
+    
+    // Format data point into buffer
+    int written = snprintf(conn.dataBuffer + conn.dataBufferPos, 
+                         sizeof(conn.dataBuffer) - conn.dataBufferPos,
+                         "%d:%lu:%lu", point.val1, point.val2, point.val3);
+    
+    if (written > 0 && conn.dataBufferPos + written < (int)sizeof(conn.dataBuffer)) {
+        conn.dataBufferPos += written;
+    }
+    
+    conn.nonZeroDataCount++;
+    Log.trace("    Non-zero data point collected (total: %d)", conn.nonZeroDataCount);
+}
+
+void queueCollectedData(PeerConnection& conn, const char* deviceName) {
+    // Caller holds connectionsLock; only copies, publishPendingData() does the slow part
+    if (conn.nonZeroDataCount == 0) {
         Log.info("No non-zero data points to publish for %s", deviceName);
         return;
     }
     
-    // Get current GPS data
-    GPSData gpsData = getGPSData();
+    if (publishQueue.count == PUBLISH_QUEUE_SIZE) {
+        publishQueue.dropped++;
+        Log.error("Publish queue full - %d data points from %s dropped", conn.nonZeroDataCount, deviceName);
+        return;
+    }
     
-    // Create JSON-like event data with GPS info
-    String eventData;
-    if (gpsData.valid) {
-        // Null terminate the data buffer
-        dataBuffer[dataBufferPos] = '\0';
-        eventData = String::format("{\"lat\":%.6f,\"lon\":%.6f,\"time\":%lld,\"device\":\"%s\",\"count\":%d,\"data\":\"%s\"}", 
-                                 gpsData.latitude, gpsData.longitude, (long long)gpsData.timestamp,
-                                 deviceName, nonZeroDataCount, dataBuffer);
-    } else {
-        // If GPS not available, use 0 values
-        // Null terminate the data buffer
-        dataBuffer[dataBufferPos] = '\0';
-        eventData = String::format("{\"lat\":0.0,\"lon\":0.0,\"time\":%lld,\"device\":\"%s\",\"count\":%d,\"data\":\"%s\"}", 
-                                 (long long)Time.now(),
-                                 deviceName, nonZeroDataCount, dataBuffer);
+    PendingPublish& entry = publishQueue.entries[(publishQueue.head + publishQueue.count) % PUBLISH_QUEUE_SIZE];
+    strlcpy(entry.device, deviceName, sizeof(entry.device));
+    entry.count = conn.nonZeroDataCount;
+    // Null terminate the data buffer
+    conn.dataBuffer[conn.dataBufferPos] = '\0';
+    memcpy(entry.data, conn.dataBuffer, conn.dataBufferPos + 1);
+    publishQueue.count++;
+    
+    Log.info("Queued %d non-zero data points from %s for publishing", conn.nonZeroDataCount, deviceName);
+}
+
+void publishPendingData() {
+    // Main loop only. Static, it is too big for the stack; each entry is copied
+    // out under the lock and published without it
+    static PendingPublish entry;
+    
+    while (true) {
+        os_mutex_lock(connectionsLock);
+        if (publishQueue.count == 0) {
+            os_mutex_unlock(connectionsLock);
+            return;
+        }
+        entry = publishQueue.entries[publishQueue.head];
+        publishQueue.head = (publishQueue.head + 1) % PUBLISH_QUEUE_SIZE;
+        publishQueue.count--;
+        os_mutex_unlock(connectionsLock);
+        
+        // Get current GPS data
+        GPSData gpsData = getGPSData();
+        
+        // Create JSON-like event data with GPS info
+        String eventData;
+        if (gpsData.valid) {
+            // fixAge: seconds since the cached fix was taken
+            eventData = String::format("{\"lat\":%.6f,\"lon\":%.6f,\"fixAge\":%lu,\"time\":%lld,\"device\":\"%s\",\"count\":%d,\"data\":\"%s\"}", 
+                                     gpsData.latitude, gpsData.longitude, gpsData.ageMs / 1000, (long long)gpsData.timestamp,
+                                     entry.device, entry.count, entry.data);
+        } else {
+            // If GPS not available, use 0 values
+            eventData = String::format("{\"lat\":0.0,\"lon\":0.0,\"time\":%lld,\"device\":\"%s\",\"count\":%d,\"data\":\"%s\"}", 
+                                     (long long)Time.now(),
+                                     entry.device, entry.count, entry.data);
+        }
+        
+        Log.info("Publishing %d non-zero data points from %s to Particle Cloud", entry.count, entry.device);
+        Log.info("Event data: %s", eventData.c_str());
+        
+        // Publish to Particle Cloud with event name "state"
+        bool published = Particle.publish("state", eventData, PRIVATE);
+        
+        if (published) {
+            Log.info("Successfully published data to Particle Cloud event 'state'");
+        } else {
+            Log.error("Failed to publish data to Particle Cloud");
+        }
+    }
+}
+
+void publishPartialBatch(PeerConnection& conn) {
+    // Nothing in flight, or the batch completed and was already published
+    if (conn.expectedTotalPackets == 0 || conn.receivedPacketCount >= conn.expectedTotalPackets) {
+        return;
     }
     
-    Log.info("Publishing %d non-zero data points from %s to Particle Cloud", nonZeroDataCount, deviceName);
-    Log.info("Event data: %s", eventData.c_str());
+    if (conn.committedPackets == 0) {
+        Log.warn("Batch interrupted before packet 1 arrived - nothing to keep");
+        recordLinkFailure(conn.peer, "batch interrupted");
+        resetDataCollection(conn);
+        return;
+    }
+    
+    Log.warn("Batch interrupted at %d/%d packets - publishing packets 1-%d", 
+             conn.receivedPacketCount, conn.expectedTotalPackets, conn.committedPackets);
+    recordLinkFailure(conn.peer, "batch interrupted");
+    
+    // Drop points from packets past the first gap, they are resent next time
+    conn.dataBufferPos = conn.committedBufferPos;
+    conn.dataBuffer[conn.dataBufferPos] = '\0';
+    conn.nonZeroDataCount = conn.committedDataCount;
+    queueCollectedData(conn, peerRegistry[conn.peer].name);
+    
+    peerRegistry[conn.peer].syncedSequence = conn.committedLastSequence;
+    peerRegistry[conn.peer].lastSyncTime = Time.now();
+    requestPeerSave(conn.peer);
+    Log.info("Records synced up to sequence %lu", conn.committedLastSequence);
+    
+    resetDataCollection(conn);
+}
+
+void recordLinkSuccess(PeerConnection& conn) {
+    PeerLinkStats& stats = peerRegistry[conn.peer].link;
+    const LinkParams& params = LINK_PARAM_LADDER[stats.level];
     
-    // Publish to Particle Cloud with event name "state"
-    bool published = Particle.publish("state", eventData, PRIVATE);
+    unsigned long elapsed = millis() - conn.transferStartTime;
+    if (elapsed > 0) {
+        stats.bytesPerSecond = conn.transferBytes * 1000UL / elapsed;
+    }
     
-    if (published) {
-        Log.info("Successfully published data to Particle Cloud event 'state'");
+    Log.info("Link to %s: interval %.2f ms, ATT MTU >= %d, %lu bytes in %lu ms (%lu B/s)", 
+             peerRegistry[conn.peer].name, params.interval * 1.25, 
+             stats.maxPacketLength + 3, conn.transferBytes, elapsed, stats.bytesPerSecond);
+    
+    // Once a rung has proven reliable, probe the next faster one
+    stats.goodTransfers++;
+    if (stats.goodTransfers >= LINK_PROMOTE_AFTER && stats.level > 0) {
+        stats.level--;
+        stats.goodTransfers = 0;
+        Log.info("Trying faster interval %.2f ms for %s next time", 
+                 LINK_PARAM_LADDER[stats.level].interval * 1.25, peerRegistry[conn.peer].name);
+    }
+    requestPeerSave(conn.peer);
+}
+
+void recordLinkFailure(int peer, const char* reason) {
+    PeerLinkStats& stats = peerRegistry[peer].link;
+    stats.goodTransfers = 0;
+    
+    if (stats.level + 1 < NUM_LINK_LEVELS) {
+        stats.level++;
+        Log.warn("Link to %s: %s - falling back to interval %.2f ms", 
+                 peerRegistry[peer].name, reason, 
+                 LINK_PARAM_LADDER[stats.level].interval * 1.25);
     } else {
-        Log.error("Failed to publish data to Particle Cloud");
+        Log.warn("Link to %s: %s at the slowest interval", 
+                 peerRegistry[peer].name, reason);
     }
-}
\ No newline at end of file
+    requestPeerSave(peer);
+}
+
+void requestPeerSave(int slot) {
+    // Caller holds connectionsLock. Flash writes are slow, savePendingPeers()
+    // does them outside it
+    if (!peerSavePending[slot]) {
+        peerSavePending[slot] = 1;
+        peerSavePendingCount++;
+    }
+}
+
+void savePendingPeers() {
+    while (true) {
+        // Copy one record under the lock, write it without
+        PeerRecord record;
+        int slot = -1;
+        os_mutex_lock(connectionsLock);
+        for (int i = 0; i < PEER_REGISTRY_CAPACITY && peerSavePendingCount > 0; i++) {
+            if (peerSavePending[i]) {
+                peerSavePending[i] = 0;
+                peerSavePendingCount--;
+                record = peerRegistry[i];
+                slot = i;
+                break;
+            }
+        }
+        os_mutex_unlock(connectionsLock);
+        
+        if (slot < 0) {
+            return;
+        }
+        writePeerRecord(slot, record);
+    }
+}
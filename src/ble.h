@@ -2,67 +2,334 @@
 #define BLE_H
 
 #include "Particle.h"
+#include <atomic>
+#include "nest_protocol.h"  // UUIDs, DataPoint and packet layout shared with the feathers
+#include "peer_registry.h"
 
-// BLE UUIDs (must match peripheral)
-#define SERVICE_UUID                   "12345678-1234-1234-1234-123456789abc"
-#define DATA_CHARACTERISTIC_UUID       "87654321-4321-4321-4321-cba987654321"
-#define ACK_CHARACTERISTIC_UUID        "11223344-5566-7788-99aa-bbccddeeff00"
+// Ask for missing packets after this long without a new one
+#define NACK_TIMEOUT_MS                1000
+// Give up on the batch (no ACK, peripheral keeps its data) after this many NACKs
+#define MAX_NACK_ROUNDS                5
 
-// Target device names - can match multiple peripherals
-extern const char* TARGET_DEVICE_NAMES[];
-extern const int NUM_TARGET_DEVICES;
+// Connection parameters the central asks for, fastest rung of the ladder first.
+// interval is in 1.25 ms units, timeout in 10 ms units.
+struct LinkParams {
+    uint16_t interval;
+    uint16_t latency;
+    uint16_t timeout;
+};
+// Length of one background scan
+#define SCAN_DURATION_MS               5000
+// Time between the starts of two scans, which also run during transfers
+#define SCAN_INTERVAL_MS               15000
+
+// Distinct devices remembered per scan, allocated once; reports from
+// further devices are dropped until the next scan
+#define SCAN_TABLE_SIZE                64
+
+// One device heard during a scan, its advertising reports merged
+struct ScanEntry {
+    BleAddress address;
+    int8_t rssi;                // Strongest report of the scan
+    uint8_t advLen;
+    uint8_t scanRspLen;
+    uint8_t advData[BLE_MAX_ADV_DATA_LEN];      // Latest payloads as raw AD structures
+    uint8_t scanRspData[BLE_MAX_ADV_DATA_LEN];
+};
+
+// How long a scan result stays fresh enough to connect to
+#define CANDIDATE_MAX_AGE_MS           60000
+
+// A feather heard in the last scan, indexed like peerRegistry
+struct ScanCandidate {
+    bool seen;                  // Heard and not served yet
+    BleAddress address;
+    int8_t rssi;
+    unsigned long lastSeen;     // millis() of the latest advertisement
+    bool hasStatus;             // Advertised a backlog status
+    AdvStatus status;
+    bool reachable;             // Its last connection attempt succeeded
+    unsigned long lastServed;   // millis() of the last connection attempt
+};
+
+// A reachable feather is reconnected by address, without a scan, this long
+// after it was last served
+#define DIRECT_CONNECT_INTERVAL_MS     15000
+
+// How long BLE.connect() waits for the peer's advertisement. Device OS bounds
+// the attempt by the scan timeout, so stepConnect() sets it before each one.
+// A direct connect is to a feather that was just served and advertises
+// every 152.5 ms at most, so a second is plenty; one that stays silent that
+// long is better found by a scan
+#define CONNECT_TIMEOUT_MS             5000
+#define DIRECT_CONNECT_TIMEOUT_MS      1000
 
-// Data structures (must match peripheral)
-struct DataPoint {
-    uint8_t val1;   // 8 bits: 0-255
-    uint32_t val2;  // 32 bits: 0 to 4,294,967,295
-    uint32_t val3;  // 32 bits: 0 to 4,294,967,295
+// Rungs tried per connection attempt before giving up until the next scan
+#define LINK_CONNECT_ATTEMPTS          2
+// Clean batches at one rung before probing the next faster one
+#define LINK_PROMOTE_AFTER             3
+
+// Per-link connection state machine. serviceConnections() advances every
+// link at most one step per main loop pass and the BLE callbacks move it on
+// when packets arrive or the link drops, so no step sleeps or waits on another.
+enum LinkState {
+    LINK_IDLE,
+    LINK_CONNECTING,            // BLE.connect() at the peer's rung, one rung per pass
+    LINK_DISCOVERING,           // Service and characteristic discovery
+    LINK_SUBSCRIBING,           // Subscribe to data notifications, send the sync request
+    LINK_SUBSCRIBED,            // Waiting for the first packet
+    LINK_RECEIVING,             // Batch in flight, gaps are NACKed
+    LINK_ACKING,                // Batch complete, the main loop writes the ACK
+    LINK_DISCONNECTING,         // Disconnect sent, waiting for onDisconnected()
+    NUM_LINK_STATES
 };
 
-struct DataPacket {
-    uint16_t packetNumber;    // 2 bytes
-    uint16_t totalPackets;    // 2 bytes
-    uint8_t pointsInPacket;   // 1 byte
-    DataPoint points[1];      // 1 point = 9 bytes, total packet = 14 bytes
+// Longest stay in a state before the link is dropped (0: no limit). Connect
+// and discovery are single synchronous Device OS calls bounded by the stack;
+// the waiting states are bounded here.
+#define SUBSCRIBE_TIMEOUT_MS           3000
+#define FIRST_PACKET_TIMEOUT_MS        5000
+#define RECEIVE_TIMEOUT_MS             60000
+#define ACK_TIMEOUT_MS                 2000
+#define DISCONNECT_TIMEOUT_MS          2000
+
+// Time spent in each state: bucket b counts stays under 2^b ms, the last one
+// everything longer
+#define LATENCY_BUCKETS                16
+
+struct PhaseLatency {
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t timeouts;
+    uint32_t maxMs;
+};
+
+// Feathers drained in parallel, as many as Device OS allows central links
+#define MAX_CONNECTIONS                BLE_MAX_LINK_COUNT
+// Collected data of one batch, as published
+#define DATA_BUFFER_SIZE               2048
+
+// Everything one link needs to receive, reassemble and acknowledge a batch
+struct PeerConnection {
+    LinkState state;
+    unsigned long stateEnteredAt;   // millis() of the last transition
+    unsigned long blockedMs;    // Main loop stuck on other links since then, added to the timeout
+    int peer;                   // Registry slot of the feather
+    BleAddress address;
+    bool direct;                // Reconnect by address: a single rung, no fallback
+    int connectAttempts;
+    BlePeerDevice device;
+    BleCharacteristic dataCharacteristic;
+    BleCharacteristic ackCharacteristic;
+    
+    // Data collection
+    char dataBuffer[DATA_BUFFER_SIZE];
+    int dataBufferPos;
+    int nonZeroDataCount;
+    
+    // Batch tracking: one bit per packet number (bit packetNumber - 1) so
+    // retransmissions can be requested selectively
+    uint8_t receivedPacketBitmap[MAX_BATCH_PACKETS / 8];
+    int expectedTotalPackets;
+    int receivedPacketCount;
+    unsigned long lastPacketReceivedTime;
+    int nackRounds;
+    bool nackRequested;
+    bool disconnectSent;        // LINK_DISCONNECTING: disconnect() already called
+    
+    // Link tuning
+    unsigned long transferStartTime;
+    uint32_t transferBytes;
+    
+    // Incremental sync: in-order prefix of the batch (packets 1..committedPackets)
+    // and where its points end in dataBuffer, so an interrupted batch can still
+    // be published
+    uint32_t receivedLastSequence;
+    int committedPackets;
+    int committedBufferPos;
+    int committedDataCount;
+    uint32_t committedLastSequence;
+};
+
+// One GATT call of a link's current state, copied out under connectionsLock
+// so serviceConnections() can make it with the lock released
+enum LinkAction {
+    LINK_ACTION_NONE,
+    LINK_ACTION_SUBSCRIBE,      // Subscribe, then write the sync request
+    LINK_ACTION_NACK,
+    LINK_ACTION_ACK,
+    LINK_ACTION_DISCONNECT
+};
+
+struct LinkStep {
+    LinkAction action;
+    LinkState state;            // The link as planned; a result only applies
+    unsigned long stateEnteredAt;   // if it is still there
+    bool timedOut;
+    char name[PEER_NAME_LEN];
+    BlePeerDevice device;
+    BleCharacteristic dataCharacteristic;
+    BleCharacteristic ackCharacteristic;
+    uint8_t payload[MAX_NACK_SIZE];     // Sync request, NACK or ACK, whichever is largest
+    size_t len;
+};
+
+// BLE events are copied into this ring by the Device OS BLE thread and handled
+// by the receive worker, so nothing slow runs on the BLE thread. One producer,
+// one consumer, no locks; a power of two. A dropped notification is a missing
+// packet the NACK round fetches again.
+#define NOTIFY_RING_SIZE               64
+// Stack of the receive worker, which also publishes
+#define RECEIVE_THREAD_STACK_SIZE      6144
+
+enum NotifyEventType : uint8_t {
+    NOTIFY_EVENT_DATA,
+    NOTIFY_EVENT_DISCONNECTED
+};
+
+// One BLE event as the callback saw it
+struct RawNotification {
+    NotifyEventType type;
+    uint8_t len;
+    BleAddress address;
+    uint8_t data[MAX_NOTIFY_PAYLOAD];
+};
+
+struct NotifyRing {
+    RawNotification slots[NOTIFY_RING_SIZE];
+    std::atomic<uint32_t> head;     // Next slot the BLE thread writes
+    std::atomic<uint32_t> tail;     // Next slot the receive worker reads
+    std::atomic<uint32_t> dropped;  // Events lost to a full ring
+};
+
+// Finished batches are copied here under connectionsLock and published by the
+// main loop, so a slow Particle.publish() never holds the lock the other links
+// need. Peer records changed under the lock are written to flash there too.
+#define PUBLISH_QUEUE_SIZE             (2 * MAX_CONNECTIONS)
+
+// One batch waiting to be published
+struct PendingPublish {
+    char device[PEER_NAME_LEN];
+    int count;
+    char data[DATA_BUFFER_SIZE];
+};
+
+struct PublishQueue {
+    PendingPublish entries[PUBLISH_QUEUE_SIZE];
+    int head;                   // Oldest entry
+    int count;
+    uint32_t dropped;           // Batches lost to a full queue
 };
 
 // Global variables for scanning
 extern bool isScanning;
 extern int scanCount;
-extern int currentTargetIndex;
+// Set when a direct connect found nobody, cleared by the main loop's next scan
+extern bool directConnectFailed;
+
+// Global variables for connections
+extern PeerConnection connections[];
+
+// Global variables for the connection state machine
+// connectionsLock guards links from LINK_SUBSCRIBING on, the receive worker
+// holds it per event and serviceConnections() to plan and apply each step,
+// never across the GATT call in between
+extern os_mutex_t connectionsLock;
+extern PhaseLatency phaseLatency[];
+extern const char* const LINK_STATE_NAMES[];
+extern const unsigned long LINK_STATE_TIMEOUT_MS[];
+
+// Global variables for the receive path
+extern NotifyRing notifyRing;
+// Guarded by connectionsLock
+extern PublishQueue publishQueue;
+extern uint8_t peerSavePending[];
+extern int peerSavePendingCount;
+extern Thread* receiveThread;
+extern os_queue_t receiveWakeQueue;
+
+// Global variables for scan results
+extern ScanEntry scanTable[];
+extern int scanTableCount;
+extern int scanTableDropped;
+extern Thread* scanThread;
+extern os_queue_t scanRequestQueue;
+extern os_queue_t scanDoneQueue;
+extern unsigned long scanStartTime;
 
-// Global variables for connection
-extern bool isConnected;
-extern BlePeerDevice connectedDevice;
-extern BleAddress targetDeviceAddress;
-extern bool disconnectRequested;
+// Global variables for scheduling
+extern ScanCandidate scanCandidates[];
 
-// Global variables for data collection
-extern char dataBuffer[];
-extern int dataBufferPos;
-extern int nonZeroDataCount;
+// Global variables for link tuning
+extern const LinkParams LINK_PARAM_LADDER[];
+extern const int NUM_LINK_LEVELS;
 
 // Global variables for services and characteristics
 extern BleUuid serviceUuid;
 extern BleUuid dataCharUuid;
 extern BleUuid ackCharUuid;
-extern BleCharacteristic dataCharacteristic;
-extern BleCharacteristic ackCharacteristic;
 
 // Function declarations
 bool initBLE();
 bool startScanning();
+void scanThreadLoop();
+bool processScanResults();
 void stopScanning();
-bool processScanResult(const BleScanResult* scanResult);
-bool connectToDevice(const BleScanResult* scanResult);
-void disconnectFromDevice();
-bool discoverServices();
-bool sendAckWithTimestamp();
-bool enableNotifications();
+void onScanResult(const BleScanResult& result, void* context);
+const uint8_t* findAdField(const uint8_t* data, size_t len, uint8_t type, size_t& fieldLen);
+bool processScanResult(const ScanEntry& entry);
+size_t readAdvStatus(const ScanEntry& entry, AdvStatus& status, const uint8_t*& data);
+bool advertisesService(const ScanEntry& entry);
+int peerForScanResult(const ScanEntry& entry);
+bool collectAdvRecords(PeerConnection& conn, const ScanEntry& entry);
+bool candidateHasWork(int slot);
+int pickNextCandidate();
+bool serveNextCandidate();
+bool connectKnownPeer();
+bool directConnectPending();
+void markServed(int slot);
+int activeConnections();
+PeerConnection* freeConnection();
+PeerConnection* connectionForPeer(int peer);
+PeerConnection* findConnection(const BleAddress& address);
+bool connectToDevice(int peer, const BleAddress& address, bool direct = false);
+void serviceConnections();
+void setLinkState(PeerConnection& conn, LinkState state);
+void stepConnect(PeerConnection& conn);
+void releaseLink(PeerConnection& conn);
+void logPhaseLatencies();
+bool discoverServices(PeerConnection& conn);
+void pauseOtherDeadlines(const PeerConnection& busy, unsigned long elapsed);
+void planLinkStep(PeerConnection& conn, LinkStep& step);
+bool planDisconnect(PeerConnection& conn, LinkStep& step);
+bool runLinkStep(LinkStep& step);
+void applyLinkStep(PeerConnection& conn, LinkStep& step, bool ok);
+size_t buildAck(uint8_t* out);
+size_t buildNack(const PeerConnection& conn, uint8_t* out);
+size_t buildSyncRequest(const PeerConnection& conn, uint8_t* out);
+bool sendAckWithTimestamp(LinkStep& step);
+bool sendNack(LinkStep& step);
+bool sendSyncRequest(LinkStep& step);
+bool checkTransferProgress(PeerConnection& conn);
+bool isPacketReceived(const PeerConnection& conn, int packetNumber);
+bool enableNotifications(LinkStep& step);
 void onDataReceived(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context);
 void onDisconnected(const BlePeerDevice& peer, void* context);
-void forceDisconnect();
-void resetDataCollection();
-void publishCollectedData(const char* deviceName);
+bool pushNotification(NotifyEventType type, const BleAddress& address, const uint8_t* data, size_t len);
+RawNotification* peekNotification();
+void popNotification();
+void receiveThreadLoop();
+void processNotification(PeerConnection& conn, const uint8_t* data, size_t len);
+void handleDisconnect(PeerConnection& conn);
+void forceDisconnect(PeerConnection& conn);
+void resetDataCollection(PeerConnection& conn);
+void collectDataPoint(PeerConnection& conn, const DataPoint& point);
+void queueCollectedData(PeerConnection& conn, const char* deviceName);
+void publishPendingData();
+void publishPartialBatch(PeerConnection& conn);
+void requestPeerSave(int slot);
+void savePendingPeers();
+void recordLinkSuccess(PeerConnection& conn);
+void recordLinkFailure(int peer, const char* reason);
 
 #endif // BLE_H
\ No newline at end of file
@@ -21,6 +21,9 @@ void setup()
 
     Log.info("V8 Central v3 Starting...");
     
+    // Feathers enrolled on earlier runs, with where each one's sync left off
+    loadPeerRegistry();
+    
     // Initialize BLE
     if (!initBLE()) {
         Log.error("Failed to initialize BLE!");
@@ -54,55 +57,57 @@ void loop()
     // Feed the application watchdog to prevent system resets
     Particle.process();
     
-    // Handle pending disconnect request FIRST (avoid BLE callback disconnect bug)
-    if (disconnectRequested && isConnected) {
-        disconnectRequested = false;
-        
-        Log.info("Processing disconnect request from main loop");
-        
-        // Send ACK before disconnecting (from main loop, not callback)
-        Log.info("Attempting to send ACK with timeout protection...");
-        Log.info("Sending ACK to peripheral...");
-        
-        if (sendAckWithTimestamp()) {
-            Log.info("ACK sent successfully from main loop");
-        } else {
-            Log.warn("ACK send failed from main loop");
-        }
-        
-        // Now disconnect regardless of ACK result
-        Log.info("Disconnecting to scan for next device...");
-        forceDisconnect();
-        
-        // Move to next target device
-        currentTargetIndex = (currentTargetIndex + 1) % NUM_TARGET_DEVICES;
-        Log.info("Moving to next target device: %s", TARGET_DEVICE_NAMES[currentTargetIndex]);
-    }
+    // Advance every link one step: connect, discover, subscribe, NACK gaps,
+    // ACK complete batches and disconnect, each bounded by its state's timeout.
+    // ACKs and disconnects run here, not in the BLE callbacks
+    serviceConnections();
+    
+    // Finished batches and changed peer records, queued by the receive worker
+    // and serviceConnections() under connectionsLock, are published and
+    // written to flash here without holding it
+    publishPendingData();
+    savePendingPeers();
     
     // GPS timing now handled in gpstime module
     
-    // Scan for devices periodically (every 15 seconds) only when not connected
+    // Feathers heard by the background scan go into the candidate table as soon as it ends
+    processScanResults();
+    
+    // Drain the feathers found by the last scan, one more whenever a link is free
+    if (freeConnection() != nullptr) {
+        serveNextCandidate();
+    }
+    
+    // Then feathers that answered last time, by address. Not while a scan is
+    // running, it may still turn up a more urgent candidate
+    if (freeConnection() != nullptr && !isScanning) {
+        connectKnownPeer();
+    }
+    
+    // Scan for devices periodically (every 15 seconds), also while a transfer
+    // is running, so the next candidate is known the moment it ends. Not
+    // while a direct connect is under way, it would stop the scan; at once if
+    // it found nobody, the feather may have moved or changed address
     static unsigned long lastScanTime = 0;
-    static unsigned long scanStartTime = 0;
-    static bool scanInProgress = false;
     
-    if (!isConnected && (millis() - lastScanTime >= 15000)) {
+    if (!isScanning && !directConnectPending() && 
+        (directConnectFailed || millis() - lastScanTime >= SCAN_INTERVAL_MS)) {
         lastScanTime = millis();
-        scanStartTime = millis();
-        scanInProgress = true;
         
-        Log.info("Starting periodic BLE scan...");
+        Log.info(directConnectFailed ? "Direct connect failed - scanning..." : "Starting periodic BLE scan...");
+        directConnectFailed = false;
         startScanning();
-        scanInProgress = false;
-        Log.info("Scan completed or timed out");
-        Log.info("Test3.7");
     }
     
-    // Watchdog: If scan has been running too long, something is wrong
-    if (scanInProgress && (millis() - scanStartTime > 30000)) {
-        Log.warn("BLE scan appears to be hanging - will retry in next cycle");
-        scanInProgress = false;
-        lastScanTime = millis() - 10000; // Retry sooner
+    // Watchdog: If scan has been running too long, something is wrong. Stop it,
+    // but leave isScanning set until the scan thread reports back, so the next
+    // scan cannot reset the result table while onScanResult() still writes it
+    static unsigned long lastScanStopTime = 0;
+    if (isScanning && (millis() - scanStartTime > 30000) && (millis() - lastScanStopTime >= 5000)) {
+        Log.warn("BLE scan appears to be hanging - stopping it");
+        lastScanStopTime = millis();
+        stopScanning();
+        lastScanTime = millis() - 10000; // Retry sooner once it has reported
     }
     
     // Show connection status and GPS timer countdown periodically
@@ -124,15 +129,22 @@ void loop()
         int minutesRemaining = secondsRemaining / 60;
         secondsRemaining = secondsRemaining % 60;
         
-        if (isConnected) {
-            Log.info("Status: CONNECTED to device (waiting for data...) | GPS Timer: %d:%02d remaining", 
-                     minutesRemaining, secondsRemaining);
+        if (activeConnections() > 0) {
+            Log.info("Status: CONNECTED to %d device(s) (waiting for data...) | GPS Timer: %d:%02d remaining", 
+                     activeConnections(), minutesRemaining, secondsRemaining);
         } else {
             Log.info("Status: NOT CONNECTED, scanning... | GPS Timer: %d:%02d remaining", 
                      minutesRemaining, secondsRemaining);
         }
     }
     
+    // Time spent in each connection phase, every 5 minutes
+    static unsigned long lastLatencyTime = 0;
+    if (millis() - lastLatencyTime >= 300000) {
+        lastLatencyTime = millis();
+        logPhaseLatencies();
+    }
+    
     // Auto-disconnect removed - now disconnects immediately after data transfer
     
     // Check for GPS update (replaces timer to avoid BLE conflicts)
@@ -1,93 +1,123 @@
 #include "gpstime.h"
 
-// Global timer instance - DISABLED due to BLE conflicts
-// Timer gpsTimer(300000, timerCallback);
-
-// Use manual timing instead
+// Use manual timing instead of a Timer, which conflicted with BLE
 unsigned long lastGPSUpdateTime = 0;
 const unsigned long GPS_UPDATE_INTERVAL = 120000; // 2 minutes
+// Each refresh is a single on-demand GNSS session, so the receiver is only
+// powered while acquiring. A fix this recent is taken as is, without one
+const unsigned long GPS_MAX_FIX_AGE = 60000;
+
+// Last-known fix cache. An acquisition writes the slot readers are not using
+// and flips currentFix once it holds a fix, so getGPSData() never waits on the
+// modem. Refreshes are minutes apart, so a reader is long done with a slot
+// before it is written again.
+LocationPoint locationFixes[2] = {};
+unsigned long locationFixTimes[2] = {};     // millis() when each slot's fix was taken
+std::atomic<int> currentFix(-1);            // Slot holding the latest fix, -1 before the first
+std::atomic<bool> locationRefreshPending(false);
+std::atomic<bool> locationRefreshDone(false);
+LocationResults lastLocationResult = LocationResults::Idle;
+static int refreshSlot = 0;
 
-// Function that returns latitude, longitude, and unix timestamp
+// Latest cached latitude, longitude and the current unix timestamp, without blocking
 GPSData getGPSData()
 {
-    GPSData data = {0.0, 0.0, 0, false};
-    
-    LocationPoint point = {};
-    // Use non-blocking GPS call to prevent system hangs
-    auto results = Location.getLocation(point, false);
+    GPSData data = {0.0, 0.0, 0, false, 0};
     
-    if (results == LocationResults::Fixed) {
-        data.latitude = point.latitude;
-        data.longitude = point.longitude;
-        data.timestamp = Time.now();
-        data.valid = true;
+    int slot = currentFix.load();
+    if (slot < 0) {
+        return data;
     }
     
+    const LocationPoint& point = locationFixes[slot];
+    data.latitude = point.latitude;
+    data.longitude = point.longitude;
+    data.timestamp = Time.now();
+    data.valid = true;
+    data.ageMs = millis() - locationFixTimes[slot];
+    
     return data;
 }
 
-// Timer callback function
-void timerCallback()
+// Starts a background acquisition into the spare slot; returns false if none was started
+bool requestLocationRefresh()
 {
-    Log.info("=== GPS TIMER FIRED - Starting GPS location update ===");
+    if (locationRefreshPending.load()) {
+        Log.info("GPS refresh still in progress");
+        return false;
+    }
     
-    // Check if BLE is scanning or connected
-    extern bool isScanning;
-    extern bool isConnected;
-    bool wasScanning = false;
+    refreshSlot = currentFix.load() == 0 ? 1 : 0;
+    locationFixes[refreshSlot] = {};
     
-    // Skip GPS if actively connected to a BLE device
-    if (isConnected) {
-        Log.warn("Skipping GPS update - BLE device connected, avoiding radio conflict");
-        return;
+    // Set before starting, the callback may run before getLocation() returns
+    locationRefreshPending.store(true);
+    auto result = Location.getLocation(locationFixes[refreshSlot], LocationDone(onLocationDone),
+                                       false, GPS_MAX_FIX_AGE);
+    if (result == LocationResults::Fixed) {
+        // Answered from a recent fix, onLocationDone() has already run
+        Log.info("GPS refresh served from a recent fix");
+        return true;
     }
-    
-    if (isScanning) {
-        Log.info("Pausing BLE scan for GPS update");
-        BLE.stopScanning();
-        wasScanning = true;
-        isScanning = false;
-        // Give radio time to switch
-        delay(500);
+    if (result != LocationResults::Acquiring) {
+        locationRefreshPending.store(false);
+        Log.warn("GPS refresh not started (result %d)", (int)result);
+        return false;
     }
     
-    // WARNING: This may block for up to 90 seconds if GPS doesn't have a fix
-    Log.warn("Attempting GPS read - may block for up to 90 seconds!");
-    
-    GPSData gpsData = getGPSData();
+    Log.info("GPS refresh started in the background");
+    return true;
+}
+
+// Runs once the acquisition ends, fixed or not: on the location thread, or
+// in getLocation() when a recent fix answers the request
+void onLocationDone(LocationResults result)
+{
+    if (result == LocationResults::Fixed) {
+        // A fix served from the library's cache may be up to GPS_MAX_FIX_AGE
+        // old, so date it by when it was taken rather than when it arrived
+        unsigned long ageMs = 0;
+        const LocationPoint& point = locationFixes[refreshSlot];
+        if (Time.isValid() && point.systemTime > 0 && Time.now() > point.systemTime) {
+            ageMs = (unsigned long)(Time.now() - point.systemTime) * 1000;
+        }
+        locationFixTimes[refreshSlot] = millis() - ageMs;
+        currentFix.store(refreshSlot);
+    }
+    lastLocationResult = result;
+    locationRefreshPending.store(false);
+    locationRefreshDone.store(true);
+}
+
+// Publishes the outcome of the last refresh, from the main loop
+void publishLocationUpdate()
+{
+    char publishData[128];
     
-    if (gpsData.valid) {
+    if (lastLocationResult == LocationResults::Fixed) {
+        GPSData gpsData = getGPSData();
+        LocationTiming timing = Location.getTiming(LocationMode::Single);
+        Log.info("GPS fix answered in %.3f s (first fix of session %.1f s)", 
+                 timing.lastLatency, timing.lastTtff);
         Log.info("GPS Data - Lat: %.6f, Lon: %.6f, Timestamp: %lld", 
                  gpsData.latitude, gpsData.longitude, (long long)gpsData.timestamp);
         
         // Publish to cloud with actual GPS coordinates and time
-        char publishData[128];
         snprintf(publishData, sizeof(publishData), 
             "{\"lat\":%.6f,\"lon\":%.6f,\"timestamp\":%lld}",
             gpsData.latitude, gpsData.longitude, (long long)gpsData.timestamp);
-        
-        Particle.publish("location-update", publishData, PRIVATE);
-        Log.info("GPS location published successfully");
     } else {
-        Log.info("GPS fix not available");
+        Log.info("GPS fix not available (result %d)", (int)lastLocationResult);
         
         // Still publish with timestamp even without GPS fix
-        char publishData[128];
         snprintf(publishData, sizeof(publishData), 
             "{\"lat\":0.0,\"lon\":0.0,\"timestamp\":%lld,\"status\":\"no_fix\"}",
             (long long)Time.now());
-        
-        Particle.publish("location-update", publishData, PRIVATE);
     }
     
-    // Resume BLE scanning if it was active before
-    if (wasScanning) {
-        delay(500); // Give radio time to switch back
-        Log.info("Resuming BLE scan after GPS update");
-        // BLE scan will resume in next loop iteration
+    if (Particle.publish("location-update", publishData, PRIVATE)) {
+        Log.info("GPS location published successfully");
     }
-    
-    Log.info("=== GPS TIMER CALLBACK COMPLETE ===");
 }
 
 // Initialize GPS functionality
@@ -101,16 +131,17 @@ void initializeGPS()
     
     // Initialize timing
     lastGPSUpdateTime = millis();
-    
-    // Timer disabled due to BLE conflicts
-    // gpsTimer.start();
 }
 
-// Check if GPS update is needed (call from main loop)
+// Publishes finished refreshes and starts the next one when due (call from main loop)
 void checkGPSUpdate()
 {
+    if (locationRefreshDone.exchange(false)) {
+        publishLocationUpdate();
+    }
+    
     if (millis() - lastGPSUpdateTime >= GPS_UPDATE_INTERVAL) {
         lastGPSUpdateTime = millis();
-        timerCallback();
+        requestLocationRefresh();
     }
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 #define GPSTIME_H
 
 #include "Particle.h"
+#include <atomic>
 #include "location.h"
 
 // Structure to hold GPS data
@@ -10,17 +11,28 @@ struct GPSData {
     double longitude;
     time_t timestamp;
     bool valid;
+    unsigned long ageMs;    // Time since the cached fix was taken
 };
 
 // Function declarations
 GPSData getGPSData();
-void timerCallback();
+bool requestLocationRefresh();
+void onLocationDone(LocationResults result);
+void publishLocationUpdate();
 void initializeGPS();
 void checkGPSUpdate();
 
-// External timer declaration - DISABLED
-// extern Timer gpsTimer;
+// Manual refresh timing, the main loop starts each acquisition
 extern unsigned long lastGPSUpdateTime;
 extern const unsigned long GPS_UPDATE_INTERVAL;
+extern const unsigned long GPS_MAX_FIX_AGE;
 
-#endif // GPSTIME_H
\ No newline at end of file
+// Last-known fix cache, double-buffered between the location thread and readers
+extern LocationPoint locationFixes[2];
+extern unsigned long locationFixTimes[2];
+extern std::atomic<int> currentFix;
+extern std::atomic<bool> locationRefreshPending;
+extern std::atomic<bool> locationRefreshDone;
+extern LocationResults lastLocationResult;
+
+#endif // GPSTIME_H
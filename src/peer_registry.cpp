@@ -0,0 +1,136 @@
+#include "peer_registry.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+// Global variables
+PeerRecord peerRegistry[PEER_REGISTRY_CAPACITY];
+int peerCount = 0;
+
+static int hashAddress(const uint8_t* address) {
+    // FNV-1a over the 6 address bytes
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < BLE_SIG_ADDR_LEN; i++) {
+        hash ^= address[i];
+        hash *= 16777619u;
+    }
+    return hash & (PEER_REGISTRY_CAPACITY - 1);
+}
+
+// Slot holding address, or the empty slot where it would go; -1 when full
+static int probePeer(const uint8_t* address) {
+    int slot = hashAddress(address);
+    for (int i = 0; i < PEER_REGISTRY_CAPACITY; i++) {
+        PeerRecord& peer = peerRegistry[slot];
+        if (!peer.used || memcmp(peer.address, address, BLE_SIG_ADDR_LEN) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & (PEER_REGISTRY_CAPACITY - 1);
+    }
+    return -1;
+}
+
+static bool writeEmptyRegistry() {
+    int fd = open(PEER_REGISTRY_FILE, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd < 0) {
+        Log.error("Failed to create %s", PEER_REGISTRY_FILE);
+        return false;
+    }
+
+    PeerRegistryHeader header = {PEER_REGISTRY_MAGIC, PEER_REGISTRY_CAPACITY, sizeof(PeerRecord)};
+    bool ok = write(fd, &header, sizeof(header)) == sizeof(header) &&
+              write(fd, peerRegistry, sizeof(peerRegistry)) == sizeof(peerRegistry);
+    close(fd);
+    return ok;
+}
+
+void loadPeerRegistry() {
+    memset(peerRegistry, 0, sizeof(peerRegistry));
+    peerCount = 0;
+
+    int fd = open(PEER_REGISTRY_FILE, O_RDONLY);
+    if (fd >= 0) {
+        PeerRegistryHeader header;
+        bool ok = read(fd, &header, sizeof(header)) == sizeof(header) &&
+                  header.magic == PEER_REGISTRY_MAGIC &&
+                  header.capacity == PEER_REGISTRY_CAPACITY &&
+                  header.recordSize == sizeof(PeerRecord) &&
+                  read(fd, peerRegistry, sizeof(peerRegistry)) == sizeof(peerRegistry);
+        close(fd);
+
+        if (ok) {
+            for (int i = 0; i < PEER_REGISTRY_CAPACITY; i++) {
+                if (peerRegistry[i].used) {
+                    peerCount++;
+                }
+            }
+            Log.info("Peer registry loaded: %d feathers", peerCount);
+            return;
+        }
+
+        Log.warn("Peer registry in %s has another layout - starting empty", PEER_REGISTRY_FILE);
+        memset(peerRegistry, 0, sizeof(peerRegistry));
+    }
+
+    writeEmptyRegistry();
+    Log.info("Peer registry created");
+}
+
+int findPeer(const BleAddress& address) {
+    uint8_t octets[BLE_SIG_ADDR_LEN];
+    address.octets(octets);
+
+    int slot = probePeer(octets);
+    return (slot >= 0 && peerRegistry[slot].used) ? slot : -1;
+}
+
+int enrolPeer(const BleAddress& address, const char* name) {
+    uint8_t octets[BLE_SIG_ADDR_LEN];
+    address.octets(octets);
+
+    int slot = probePeer(octets);
+    if (slot < 0) {
+        Log.error("Peer registry full (%d feathers) - cannot enrol %s", peerCount, name);
+        return -1;
+    }
+
+    PeerRecord& peer = peerRegistry[slot];
+    if (!peer.used) {
+        memset(&peer, 0, sizeof(peer));
+        peer.used = 1;
+        memcpy(peer.address, octets, BLE_SIG_ADDR_LEN);
+        peerCount++;
+        Log.info("Enrolled %s as peer %d (%d feathers)", name, slot, peerCount);
+    }
+
+    // Names may change with a firmware update, the address is the identity
+    if (strncmp(peer.name, name, PEER_NAME_LEN - 1) != 0) {
+        strlcpy(peer.name, name, PEER_NAME_LEN);
+    }
+    return slot;
+}
+
+bool savePeer(int slot) {
+    if (slot < 0 || slot >= PEER_REGISTRY_CAPACITY) {
+        return false;
+    }
+    return writePeerRecord(slot, peerRegistry[slot]);
+}
+
+bool writePeerRecord(int slot, const PeerRecord& record) {
+    // Records sit at fixed offsets, so one peer is rewritten in place
+    int fd = open(PEER_REGISTRY_FILE, O_WRONLY);
+    if (fd < 0) {
+        Log.error("Failed to open %s", PEER_REGISTRY_FILE);
+        return false;
+    }
+
+    off_t offset = sizeof(PeerRegistryHeader) + slot * sizeof(PeerRecord);
+    bool ok = lseek(fd, offset, SEEK_SET) == offset &&
+              write(fd, &record, sizeof(PeerRecord)) == sizeof(PeerRecord);
+    close(fd);
+
+    if (!ok) {
+        Log.error("Failed to save peer %d", slot);
+    }
+    return ok;
+}
@@ -0,0 +1,55 @@
+#ifndef PEER_REGISTRY_H
+#define PEER_REGISTRY_H
+
+#include "Particle.h"
+
+// Fixed-capacity open-addressing table of the feathers this nest serves, keyed
+// by BLE address and persisted to flash. A power of two so the hash can be
+// masked; stays under half full with more than 100 feathers per nest.
+#define PEER_REGISTRY_CAPACITY         256
+#define PEER_NAME_LEN                  16
+#define PEER_REGISTRY_FILE             "/peers.bin"
+#define PEER_REGISTRY_MAGIC            0x31524750  // "PGR1"
+
+// What a peer's link actually achieved
+struct PeerLinkStats {
+    uint8_t level;              // Rung of LINK_PARAM_LADDER used for this peer
+    uint8_t goodTransfers;      // Complete batches since the last level change
+    uint16_t connectFailures;
+    uint16_t maxPacketLength;   // Largest notification seen; the ATT MTU is at least this + 3
+    uint32_t bytesPerSecond;    // Throughput of the last complete batch
+};
+
+// One slot of the registry, stored in the file as-is
+struct PeerRecord {
+    uint8_t used;
+    uint8_t address[BLE_SIG_ADDR_LEN];
+    char name[PEER_NAME_LEN];   // Advertised name, for logs and published events
+    uint32_t syncedSequence;    // Newest record published, the next connection resumes after it
+    uint32_t lastSyncTime;      // Unix time of the last upload
+    PeerLinkStats link;
+};
+
+// File header; a mismatch (other layout or capacity) starts an empty registry
+struct PeerRegistryHeader {
+    uint32_t magic;
+    uint16_t capacity;
+    uint16_t recordSize;
+};
+
+// Global variables
+// The nest's receive worker reads the entries of linked feathers, so entries
+// are changed under connectionsLock (ble.h) and saved outside it; the main
+// loop reads without it
+extern PeerRecord peerRegistry[];
+extern int peerCount;
+
+// Function declarations
+void loadPeerRegistry();
+int findPeer(const BleAddress& address);
+// Does not save the slot, that is up to the caller
+int enrolPeer(const BleAddress& address, const char* name);
+bool savePeer(int slot);
+bool writePeerRecord(int slot, const PeerRecord& record);
+
+#endif // PEER_REGISTRY_H